@@ -3,11 +3,63 @@
 //
 
 #include "AsyncServer.h"
-
+#include "FileCache.h"
+#include "KeyValueStore.h"
+#include "PubSub.h"
+#include "StatsSegment.h"
+#include "TextScan.h"
+#include "LoopbackTransport.h"
+#include "TrafficCapture.h"
+#include "UpstreamPool.h"
+
+#include <algorithm>
 #include <arpa/inet.h>
+#include <csignal>
 #include <cstring>
+#include <iomanip>
 #include <iostream>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+    void onTraceDumpSignal(int) {
+        Tracer::requestDump();
+    }
+    bool makeUnixAddress(const std::string& path, sockaddr_un& addr) {
+        addr = sockaddr_un{};
+        addr.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+            std::cerr << "Invalid unix socket path: '" << path << "'" << std::endl;
+            return false;
+        }
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        return true;
+    }
+}
+
+std::string PeerAddress::toString() const {
+    if (storage.ss_family == AF_INET) {
+        const auto* addr = reinterpret_cast<const sockaddr_in*>(&storage);
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &addr->sin_addr, ip, sizeof(ip));
+        return std::string(ip) + ":" + std::to_string(ntohs(addr->sin_port));
+    }
+    if (storage.ss_family == AF_UNIX) {
+        const auto* addr = reinterpret_cast<const sockaddr_un*>(&storage);
+        if (length <= offsetof(sockaddr_un, sun_path) || addr->sun_path[0] == '\0') {
+            return "unix:(unnamed)";
+        }
+        return std::string("unix:") + addr->sun_path;
+    }
+    return "unknown";
+}
 
 EPollManager::EPollManager() {
     std::cout << "EPollManager::EPollManager" << std::endl;
@@ -18,9 +70,14 @@ EPollManager::EPollManager() {
     }
 }
 EPollManager::~EPollManager() {
-    if (m_epoll_fd != -1) {
-        ::close(m_epoll_fd);
+    // Simulated managers have no epoll instance and their wakeup fd is not a kernel descriptor
+    if (m_epoll_fd == -1) {
+        return;
+    }
+    if (m_wakeup_fd != -1) {
+        ::close(m_wakeup_fd);
     }
+    ::close(m_epoll_fd);
 }
 void EPollManager::addFD(int fd, uint32_t events) {
     std::cout << "EPollManager::addFD" << std::endl;
@@ -50,7 +107,7 @@ void EPollManager::modifyFD(int fd, uint32_t events) {
     }
 
 }
-void EPollManager::removeFD(int fd) const {
+void EPollManager::removeFD(int fd) {
     std::cout << "EPollManager::removeFD" << std::endl;
     if (m_epoll_fd == -1) {
         return;
@@ -61,6 +118,33 @@ void EPollManager::removeFD(int fd) const {
 }
 
 
+int EPollManager::enableWakeup() {
+    if (m_wakeup_fd != -1) {
+        return m_wakeup_fd;
+    }
+    m_wakeup_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_wakeup_fd == -1) {
+        throw std::system_error(errno, std::system_category(), "eventfd failed");
+    }
+    addFD(m_wakeup_fd, EPOLLIN);
+    return m_wakeup_fd;
+}
+void EPollManager::wakeup() {
+    // One write per batch of posts: later callers see the flag and skip the syscall
+    if (m_wakeup_fd == -1 || m_wakeupPending.exchange(true, std::memory_order_acq_rel)) {
+        return;
+    }
+    uint64_t one = 1;
+    if (::write(m_wakeup_fd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+        std::cerr << "eventfd write failed: " << strerror(errno) << std::endl;
+    }
+}
+void EPollManager::clearWakeup() {
+    m_wakeupPending.store(false, std::memory_order_release);
+    uint64_t count = 0;
+    while (::read(m_wakeup_fd, &count, sizeof(count)) > 0) {
+    }
+}
 int EPollManager::waitForEvents(epoll_event *events, int maxEvents, int timeout) {
     // std::cout << "EPollManager::waitForEvents" << std::endl;
     if (m_epoll_fd == -1) {
@@ -78,6 +162,24 @@ int EPollManager::waitForEvents(epoll_event *events, int maxEvents, int timeout)
     }
     return (count == -1) ? 0 : count;
 }
+bool EPollManager::setBusyPoll(uint32_t usecs, uint16_t budget) {
+#ifdef EPIOCSPARAMS
+    epoll_params params{};
+    params.busy_poll_usecs = usecs;
+    params.busy_poll_budget = budget;
+    params.prefer_busy_poll = 1;
+    if (::ioctl(m_epoll_fd, EPIOCSPARAMS, &params) == -1) {
+        std::cerr << "EPIOCSPARAMS failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+#else
+    (void) usecs;
+    (void) budget;
+    std::cerr << "epoll busy poll parameters are not supported by this build" << std::endl;
+    return false;
+#endif
+}
 UDPServer::~UDPServer() {
     std::cout << "UDPServer::~UDPServer" << std::endl;
     stop();
@@ -123,11 +225,62 @@ bool UDPServer::start(std::string &ip, int port, EPollManager *epollManager) {
         return false;
     }
 
+    return registerSocket();
+}
+bool UDPServer::startUnix(const std::string &path, EPollManager *epollManager) {
+    std::cout << "UDPServer::startUnix " << path << std::endl;
+    if (m_running) {
+        std::cout << "UDPServer already running" << std::endl;
+        return false;
+    }
+
+    sockaddr_un server_addr{};
+    if (!makeUnixAddress(path, server_addr)) {
+        return false;
+    }
+
+    m_epollManager = epollManager;
+    m_server_fd = ::socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (m_server_fd == -1) {
+        std::cerr << "Unix datagram socket failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    ::unlink(path.c_str());
+    if (::bind(m_server_fd, reinterpret_cast<sockaddr*>(&server_addr), sizeof(server_addr)) == -1) {
+        std::cerr << "Unix datagram bind() failed to " << path << ": " << strerror(errno) << std::endl;
+        ::close(m_server_fd);
+        m_server_fd = -1;
+        return false;
+    }
+    m_unixPath = path;
+
+    return registerSocket();
+}
+bool UDPServer::attach(int fd, EPollManager *epollManager, Transport *transport) {
+    if (m_running) {
+        std::cout << "UDPServer already running" << std::endl;
+        return false;
+    }
+    m_epollManager = epollManager;
+    m_transport = transport;
+    try {
+        m_epollManager->addFD(fd, SERVER_EVENTS);
+    } catch (const std::exception &e) {
+        std::cerr << "UDP epoll add failed: " << e.what() << std::endl;
+        return false;
+    }
+    m_server_fd = fd;
+    m_running = true;
+    return true;
+}
+bool UDPServer::registerSocket() {
     try {
-        m_epollManager->addFD(m_server_fd, EPOLLIN | EPOLLET);
+        m_epollManager->addFD(m_server_fd, SERVER_EVENTS);
     } catch (const std::exception& e) {
         std::cerr << "UDP epoll add failed: " << e.what() << std::endl;
         ::close(m_server_fd);
+        m_server_fd = -1;
         return false;
     }
 
@@ -145,6 +298,9 @@ void UDPServer::stop() {
     }
 
     m_running = false;
+    m_sendQueue.clear();
+    m_writeArmed = false;
+    updateQueueStats();
 
     try {
         if (m_epollManager && m_server_fd != -1) {
@@ -156,13 +312,17 @@ void UDPServer::stop() {
             }
         }
         if (m_server_fd != -1) {
-            if (::close(m_server_fd) == -1) {
+            if (m_transport->close(m_server_fd) == -1) {
                 std::cerr << "UDP server close failed: " << strerror(errno) << std::endl;
             } else {
                 std::cout << "UDP server closed" << std::endl;
             }
             m_server_fd = -1;
         }
+        if (!m_unixPath.empty()) {
+            ::unlink(m_unixPath.c_str());
+            m_unixPath.clear();
+        }
         m_epollManager = nullptr;
         std::cout << "UDP server stopped" << std::endl;
     } catch (const std::exception& e) {
@@ -171,7 +331,8 @@ void UDPServer::stop() {
         m_epollManager = nullptr;
     }
 }
-bool UDPServer::sendResponse(const sockaddr_in &clientAddr, const std::string &data) {
+bool UDPServer::sendResponse(const PeerAddress &clientAddr, const std::string &data) {
+    TraceSpan span(TraceStage::UdpSend, m_server_fd);
     if (!m_running || m_server_fd == -1) {
         std::cerr << "Cannot send - UDP Server not running";
         return false;
@@ -182,21 +343,18 @@ bool UDPServer::sendResponse(const sockaddr_in &clientAddr, const std::string &d
         return false;
     }
 
-    ssize_t bytesSent = ::sendto(
-        m_server_fd,
-        data.data(),
-        data.size(),
-        0,
-        reinterpret_cast<const sockaddr *>(&clientAddr),
-        sizeof(clientAddr)
-        );
+    if (!m_sendQueue.empty()) {
+        // Keep datagram order behind responses waiting for EPOLLOUT
+        return enqueueResponse(clientAddr, data);
+    }
+
+    ssize_t bytesSent = m_transport->sendto(m_server_fd, data.data(), data.size(), clientAddr);
 
     if (bytesSent == -1) {
         if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            std::cerr << "UDP send buffer full, packet dropped" << std::endl;
-        } else {
-            std::cerr << "UDP sendto error: " << strerror(errno) << std::endl;
+            return enqueueResponse(clientAddr, data);
         }
+        std::cerr << "UDP sendto error: " << strerror(errno) << std::endl;
         return false;
     }
 
@@ -205,17 +363,84 @@ bool UDPServer::sendResponse(const sockaddr_in &clientAddr, const std::string &d
         return false;
     }
 
-    char client_ip[INET_ADDRSTRLEN];
-    inet_ntop(AF_INET, &clientAddr.sin_addr, client_ip, sizeof(client_ip));
-    int client_port = ntohs(clientAddr.sin_port);
-
-    std::cout << "UDP sent " << bytesSent << " bytes to " << client_ip << ":" << client_port << std::endl;
+    std::cout << "UDP sent " << bytesSent << " bytes to " << clientAddr.toString() << std::endl;
     std::cout << "\tResponse: " << data << std::endl;
     return true;
 }
+void UDPServer::handleWritable() {
+    while (!m_sendQueue.empty()) {
+        mmsghdr messages[SEND_BATCH]{};
+        iovec iov[SEND_BATCH];
+        size_t batch = std::min(m_sendQueue.size(), SEND_BATCH);
+        for (size_t i = 0; i < batch; ++i) {
+            PendingDatagram& datagram = m_sendQueue[i];
+            iov[i].iov_base = datagram.data.data();
+            iov[i].iov_len = datagram.data.size();
+            messages[i].msg_hdr.msg_name = datagram.clientAddr.get();
+            messages[i].msg_hdr.msg_namelen = datagram.clientAddr.length;
+            messages[i].msg_hdr.msg_iov = &iov[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int sent = m_transport->sendmmsg(m_server_fd, messages, static_cast<unsigned int>(batch));
+        if (sent == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;  // still full, wait for the next EPOLLOUT
+            }
+            // The first datagram is undeliverable, skip it and go on with the rest
+            std::cerr << "UDP sendmmsg error: " << strerror(errno) << std::endl;
+            sent = 1;
+        }
+        m_sendQueue.erase(m_sendQueue.begin(), m_sendQueue.begin() + sent);
+    }
+
+    if (m_sendQueue.empty()) {
+        setWriteInterest(false);
+    }
+    updateQueueStats();
+}
+bool UDPServer::enqueueResponse(const PeerAddress &clientAddr, const std::string &data) {
+    if (m_sendQueue.size() >= MAX_SEND_QUEUE) {
+        // Tail drop: the datagrams already queued are older and keep their place
+        if (m_stats) {
+            m_stats->udpResponseDropped();
+        }
+        std::cerr << "UDP send queue full, packet dropped" << std::endl;
+        return false;
+    }
+    m_sendQueue.push_back(PendingDatagram{clientAddr, data});
+    if (m_stats) {
+        m_stats->udpResponseDeferred();
+    }
+    setWriteInterest(true);
+    updateQueueStats();
+    return true;
+}
+void UDPServer::setWriteInterest(bool enabled) {
+    if (m_writeArmed == enabled || !m_epollManager) {
+        return;
+    }
+    try {
+        m_epollManager->modifyFD(m_server_fd, enabled ? SERVER_EVENTS | EPOLLOUT : SERVER_EVENTS);
+        m_writeArmed = enabled;
+    } catch (const std::exception& e) {
+        std::cerr << "UDP epoll modify failed: " << e.what() << std::endl;
+    }
+}
+void UDPServer::updateQueueStats() {
+    if (m_stats && m_sendQueue.size() != m_reportedQueueDepth) {
+        m_stats->adjustUdpQueueDepth(static_cast<ptrdiff_t>(m_sendQueue.size())
+                                     - static_cast<ptrdiff_t>(m_reportedQueueDepth));
+        m_reportedQueueDepth = m_sendQueue.size();
+    }
+}
 
 
 void UDPServer::printServerInfo() {
+    if (!m_unixPath.empty()) {
+        std::cout << "UdpServerPath:  " << m_unixPath << std::endl;
+        return;
+    }
     sockaddr_in actual_addr{};
     socklen_t addr_len = sizeof(actual_addr);
 
@@ -237,6 +462,13 @@ ServerInfo UDPServer::getServerInfo() {
         m_serverInfo.errorMessage = m_running ? "Socket is invalid" : "Server is not running";
         return m_serverInfo;
     }
+    if (!m_unixPath.empty()) {
+        m_serverInfo.serverIP = "unix:" + m_unixPath;
+        m_serverInfo.port = 0;
+        m_serverInfo.clientCount = 0;
+        m_serverInfo.errorMessage = "";
+        return m_serverInfo;
+    }
 
     sockaddr_in actual_addr{};
     socklen_t addr_len = sizeof(actual_addr);
@@ -257,37 +489,9 @@ ServerInfo UDPServer::getServerInfo() {
     }
     return m_serverInfo;
 }
-void UDPServer::handleMessage() const {
-    constexpr size_t BUFFER_SIZE = 1024;
-    char buffer[BUFFER_SIZE];
-    sockaddr_in clientAddr{};
-    socklen_t addr_len = sizeof(clientAddr);
-
-    while (true) {
-        ssize_t bytesReceived = ::recvfrom(
-        m_server_fd,
-        buffer,
-        BUFFER_SIZE - 1,
-        0,
-        reinterpret_cast<sockaddr*>(&clientAddr),
-        &addr_len);
-        if (bytesReceived > 0) {
-            buffer[bytesReceived] = '\0';
-            std::string message(buffer);
-
-            if (m_messageCallback) {
-                m_messageCallback(message, clientAddr);
-            }
-        } else {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                break;
-            } else {
-                std::cerr << "UDP recvfrom error: " << strerror(errno) << std::endl;
-                break;
-            }
-        }
-    }
-
+void UDPServer::handleMessage() {
+    CallbackHandler handler{m_messageCallback};
+    handleMessage(handler);
 }
 
 TCPServer::~TCPServer() {
@@ -349,6 +553,107 @@ bool TCPServer::start(std::string &ip, int port, EPollManager *epollManager) {
     m_running = true;
     return true;
 }
+bool TCPServer::attach(int listen_fd, EPollManager *epollManager, Transport *transport) {
+    if (m_running) {
+        std::cout << "TCPServer already running" << std::endl;
+        return false;
+    }
+    m_epollManager = epollManager;
+    m_transport = transport;
+    try {
+        m_epollManager->addFD(listen_fd, EPOLLIN);
+    } catch (const std::exception &e) {
+        std::cerr << "TCP listener epoll add failed: " << e.what() << std::endl;
+        return false;
+    }
+    m_server_fd = listen_fd;
+    m_running = true;
+    return true;
+}
+bool TCPServer::listenUnix(const std::string &path) {
+    std::cout << "TCPServer::listenUnix " << path << std::endl;
+    if (!m_running || m_unix_fd != -1) {
+        std::cerr << "Unix listener needs a running TCP server and can be added once" << std::endl;
+        return false;
+    }
+
+    sockaddr_un serv_addr{};
+    if (!makeUnixAddress(path, serv_addr)) {
+        return false;
+    }
+
+    m_unix_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (m_unix_fd == -1) {
+        std::cerr << "Unix stream socket failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    // Stale socket file from a previous run would make bind() fail
+    ::unlink(path.c_str());
+    if (::bind(m_unix_fd, reinterpret_cast<sockaddr*>(&serv_addr), sizeof(serv_addr)) == -1
+        || ::listen(m_unix_fd, SOMAXCONN) == -1) {
+        std::cerr << "Unix listener failed on " << path << ": " << strerror(errno) << std::endl;
+        ::close(m_unix_fd);
+        m_unix_fd = -1;
+        return false;
+    }
+
+    try {
+        m_epollManager->addFD(m_unix_fd, EPOLLIN);
+    } catch (const std::exception &e) {
+        std::cerr << "Unix listener epoll add failed: " << e.what() << std::endl;
+        ::close(m_unix_fd);
+        m_unix_fd = -1;
+        ::unlink(path.c_str());
+        return false;
+    }
+    m_unixPath = path;
+    std::cout << "TCP Server listening on unix:" << path << std::endl;
+    return true;
+}
+bool TCPServer::listenAdmin(const std::string &ip, int port) {
+    std::cout << "TCPServer::listenAdmin " << ip << ":" << port << std::endl;
+    if (!m_running || m_admin_fd != -1) {
+        std::cerr << "Admin listener needs a running TCP server and can be added once" << std::endl;
+        return false;
+    }
+
+    sockaddr_in serv_addr{};
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_port = htons(port);
+    if (ip == "0.0.0.0") {
+        serv_addr.sin_addr.s_addr = INADDR_ANY;
+    } else if (inet_pton(AF_INET, ip.c_str(), &serv_addr.sin_addr) != 1) {
+        std::cerr << "Invalid admin IP address: " << ip << std::endl;
+        return false;
+    }
+
+    m_admin_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (m_admin_fd == -1) {
+        std::cerr << "Admin socket failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+    int opt = 1;
+    ::setsockopt(m_admin_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (::bind(m_admin_fd, reinterpret_cast<sockaddr*>(&serv_addr), sizeof(serv_addr)) == -1
+        || ::listen(m_admin_fd, SOMAXCONN) == -1) {
+        std::cerr << "Admin listener failed on " << ip << ":" << port << ": " << strerror(errno) << std::endl;
+        ::close(m_admin_fd);
+        m_admin_fd = -1;
+        return false;
+    }
+
+    try {
+        m_epollManager->addFD(m_admin_fd, EPOLLIN);
+    } catch (const std::exception &e) {
+        std::cerr << "Admin listener epoll add failed: " << e.what() << std::endl;
+        ::close(m_admin_fd);
+        m_admin_fd = -1;
+        return false;
+    }
+    std::cout << "TCP Server admin listener on " << ip << ":" << port << std::endl;
+    return true;
+}
 void TCPServer::stop() {
     std::cout << "TCPServer::stop" << std::endl;
     if (!m_running) {
@@ -371,19 +676,20 @@ void TCPServer::stop() {
         }
 
         // Close clients sockets
-        if (::close(client_fd) == -1) {
+        if (m_transport->close(client_fd) == -1) {
             std::cerr << "Warning: Failed to close client socket "
             << client_fd << ": " << strerror(errno) << std::endl;
         }
         it = m_clients.erase(it);
     }
+    m_readyClients.clear();
 
     // Close server sockets
     if (m_server_fd != -1) {
         if (m_epollManager) {
             m_epollManager->removeFD(m_server_fd);
         }
-        if (::close(m_server_fd) == -1) {
+        if (m_transport->close(m_server_fd) == -1) {
             std::cerr << "Warning: Failed to close server socket: "
                       << strerror(errno) << std::endl;
         } else {
@@ -391,9 +697,29 @@ void TCPServer::stop() {
         }
         m_server_fd = -1;
     }
+
+    if (m_admin_fd != -1) {
+        if (m_epollManager) {
+            m_epollManager->removeFD(m_admin_fd);
+        }
+        ::close(m_admin_fd);
+        m_admin_fd = -1;
+    }
+
+    if (m_unix_fd != -1) {
+        if (m_epollManager) {
+            m_epollManager->removeFD(m_unix_fd);
+        }
+        ::close(m_unix_fd);
+        ::unlink(m_unixPath.c_str());
+        m_unix_fd = -1;
+        m_unixPath.clear();
+    }
 }
 bool TCPServer::sendData(int client_fd, const std::string &data) {
-    if (m_clients.find(client_fd) == m_clients.end()) {
+    TraceSpan span(TraceStage::TcpSend, client_fd);
+    auto it = m_clients.find(client_fd);
+    if (it == m_clients.end()) {
         std::cerr << "Cannot send data - client " << client_fd << " not found" << std::endl;
         return false;
     }
@@ -407,17 +733,251 @@ bool TCPServer::sendData(int client_fd, const std::string &data) {
         return false;
     }
 
-    ssize_t bytes_sent = send(client_fd, data.data(), data.size(), 0);
+    ClientState& client = it->second;
+    if (!client.outQueue.empty()) {
+        // Keep ordering behind data that is already waiting for EPOLLOUT
+        return enqueueOutput(client_fd, client, std::make_shared<const std::string>(data), 0);
+    }
+
+    ssize_t bytes_sent = m_transport->send(client_fd, data.data(), data.size());
     if (bytes_sent == -1) {
         if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            std::cerr << "TCP send error to client " << client_fd << ": " << strerror(errno) << std::endl;
             disconnectClient(client_fd);
+            return false;
+        }
+        bytes_sent = 0;
+    }
+    client.stats.bytesOut += bytes_sent;
+    if (static_cast<size_t>(bytes_sent) < data.size()) {
+        return enqueueOutput(client_fd, client, std::make_shared<const std::string>(data, bytes_sent), 0);
+    }
+
+    return true;
+}
+bool TCPServer::sendShared(int client_fd, const SharedBuffer &data) {
+    auto it = m_clients.find(client_fd);
+    if (it == m_clients.end() || !m_running || !data || data->empty()) {
+        return false;
+    }
+
+    ClientState& client = it->second;
+    if (!client.outQueue.empty()) {
+        return enqueueOutput(client_fd, client, data, 0);
+    }
+
+    ssize_t bytes_sent = m_transport->send(client_fd, data->data(), data->size());
+    if (bytes_sent == -1) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
             std::cerr << "TCP send error to client " << client_fd << ": " << strerror(errno) << std::endl;
+            disconnectClient(client_fd);
+            return false;
         }
+        bytes_sent = 0;
+    }
+    client.stats.bytesOut += bytes_sent;
+    if (static_cast<size_t>(bytes_sent) < data->size()) {
+        // The buffer itself is queued, only the offset is per client
+        return enqueueOutput(client_fd, client, data, bytes_sent);
+    }
+    return true;
+}
+bool TCPServer::sendFile(int client_fd, FilePtr file) {
+    auto it = m_clients.find(client_fd);
+    if (it == m_clients.end() || !m_running || !file) {
         return false;
     }
+    if (file->size == 0) {
+        return true;
+    }
+
+    ClientState& client = it->second;
+    if (!client.outQueue.empty()) {
+        return enqueueFile(client_fd, client, std::move(file), 0);
+    }
 
+    off_t offset = 0;
+    ssize_t bytes_sent = m_transport->sendfile(client_fd, file->fd, &offset, file->size);
+    if (bytes_sent == -1) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            std::cerr << "sendfile to client " << client_fd << " failed: " << strerror(errno) << std::endl;
+            disconnectClient(client_fd);
+            return false;
+        }
+        offset = 0;
+    } else {
+        client.stats.bytesOut += bytes_sent;
+    }
+    if (static_cast<size_t>(offset) < file->size) {
+        // The rest follows on EPOLLOUT straight from the page cache
+        return enqueueFile(client_fd, client, std::move(file), offset);
+    }
+    return true;
+}
+void TCPServer::handleWritable(int client_fd) {
+    auto it = m_clients.find(client_fd);
+    if (it == m_clients.end()) {
+        return;
+    }
+    ClientState& client = it->second;
+    // false means the client is gone; the callback may send or disconnect, client is not used after it
+    if (flushOutput(client_fd, client) && client.outQueue.empty() && m_drainCallback) {
+        m_drainCallback(client_fd);
+    }
+}
+bool TCPServer::hasPendingOutput(int client_fd) const {
+    auto it = m_clients.find(client_fd);
+    return it != m_clients.end() && !it->second.outQueue.empty();
+}
+bool TCPServer::enqueueOutput(int client_fd, ClientState &client, SharedBuffer buffer, size_t offset) {
+    const size_t pending = buffer->size() - offset;
+    if (client.queuedBytes + pending > MAX_OUTPUT_QUEUE_BYTES) {
+        std::cerr << "TCP client " << client_fd << " output queue overflow ("
+                  << client.queuedBytes << " bytes pending), disconnecting" << std::endl;
+        disconnectClient(client_fd);
+        return false;
+    }
+    if (client.outQueue.empty()) {
+        client.outOffset = offset;
+    }
+    client.outQueue.push_back(OutputItem{std::move(buffer)});
+    client.queuedBytes += pending;
+    setWriteInterest(client_fd, client, true);
     return true;
 }
+bool TCPServer::enqueueFile(int client_fd, ClientState &client, FilePtr file, off_t offset) {
+    OutputItem item;
+    item.fileOffset = offset;
+    item.fileRemaining = file->size - static_cast<size_t>(offset);
+    item.file = std::move(file);
+    // File bytes are read by the kernel on demand, they do not count against the memory cap
+    client.outQueue.push_back(std::move(item));
+    setWriteInterest(client_fd, client, true);
+    return true;
+}
+bool TCPServer::flushOutput(int client_fd, ClientState &client) {
+    constexpr size_t MAX_IOV = 16;
+    constexpr size_t SENDFILE_CHUNK = 1024 * 1024;
+
+    while (!client.outQueue.empty()) {
+        OutputItem& front = client.outQueue.front();
+        if (front.file) {
+            ssize_t bytes_sent = m_transport->sendfile(client_fd, front.file->fd, &front.fileOffset,
+                                            std::min(front.fileRemaining, SENDFILE_CHUNK));
+            if (bytes_sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return true;
+            }
+            if (bytes_sent <= 0) {
+                // 0 means the file shrank after its size was announced, the client cannot recover
+                std::cerr << "sendfile to client " << client_fd << " failed: "
+                          << (bytes_sent == 0 ? "file truncated" : strerror(errno)) << std::endl;
+                disconnectClient(client_fd);
+                return false;
+            }
+            client.stats.bytesOut += bytes_sent;
+            front.fileRemaining -= bytes_sent;
+            if (front.fileRemaining == 0) {
+                client.outQueue.pop_front();
+            }
+            continue;
+        }
+
+        // Memory buffers up to the next file go out in one sendmsg
+        iovec iov[MAX_IOV];
+        size_t iov_count = 0;
+        for (auto it = client.outQueue.begin(); it != client.outQueue.end() && !it->file && iov_count < MAX_IOV; ++it) {
+            size_t offset = iov_count == 0 ? client.outOffset : 0;
+            iov[iov_count].iov_base = const_cast<char*>(it->buffer->data() + offset);
+            iov[iov_count].iov_len = it->buffer->size() - offset;
+            ++iov_count;
+        }
+
+        ssize_t bytes_sent = m_transport->sendv(client_fd, iov, iov_count);
+        if (bytes_sent == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return true;
+            }
+            std::cerr << "TCP send error to client " << client_fd << ": " << strerror(errno) << std::endl;
+            disconnectClient(client_fd);
+            return false;
+        }
+
+        client.queuedBytes -= bytes_sent;
+        client.stats.bytesOut += bytes_sent;
+        size_t left = bytes_sent;
+        while (left > 0) {
+            size_t in_front = client.outQueue.front().buffer->size() - client.outOffset;
+            if (left < in_front) {
+                client.outOffset += left;
+                break;
+            }
+            left -= in_front;
+            client.outQueue.pop_front();
+            client.outOffset = 0;
+        }
+    }
+
+    setWriteInterest(client_fd, client, false);
+    return true;
+}
+bool TCPServer::recordRequest(int client_fd, size_t bytes, LoopClock::time_point started) {
+    // The handler may have disconnected the client
+    auto it = m_clients.find(client_fd);
+    if (it == m_clients.end()) {
+        return false;
+    }
+    ClientStats& stats = it->second.stats;
+    stats.lastActivity = LoopClock::now();
+    stats.bytesIn += bytes;
+    ++stats.requests;
+    stats.latency.add(elapsedNs(started, stats.lastActivity));
+    return true;
+}
+void TCPServer::queueRead(int client_fd) {
+    auto it = m_clients.find(client_fd);
+    if (it == m_clients.end() || it->second.readQueued) {
+        return;
+    }
+    it->second.readQueued = true;
+    m_readyClients.push_back(client_fd);
+    if (m_stats) {
+        m_stats->getLoopStats().readYield();
+    }
+}
+void TCPServer::collectClientStats(std::vector<ClientStatsRow> &rows) const {
+    const auto now = LoopClock::now();
+    rows.clear();
+    rows.reserve(m_clients.size());
+    for (const auto& [fd, client] : m_clients) {
+        const ClientStats& stats = client.stats;
+        double seconds = std::chrono::duration<double>(now - stats.connectedAt).count();
+        rows.push_back({fd, stats.bytesIn + stats.bytesOut, stats.requests,
+                        stats.requests / std::max(seconds, 1.0), &stats});
+    }
+}
+std::string* TCPServer::getInputTail(int client_fd) {
+    auto it = m_clients.find(client_fd);
+    return it == m_clients.end() ? nullptr : &it->second.inputTail;
+}
+std::string TCPServer::getClientAddress(int client_fd) const {
+    auto it = m_clients.find(client_fd);
+    return it == m_clients.end() ? "?" : it->second.addr.toString();
+}
+bool TCPServer::isAdmin(int client_fd) const {
+    auto it = m_clients.find(client_fd);
+    return it != m_clients.end() && it->second.admin;
+}
+void TCPServer::setWriteInterest(int client_fd, ClientState &client, bool enabled) {
+    if (client.writeArmed == enabled || !m_epollManager) {
+        return;
+    }
+    try {
+        m_epollManager->modifyFD(client_fd, enabled ? CLIENT_EVENTS | EPOLLOUT : CLIENT_EVENTS);
+        client.writeArmed = enabled;
+    } catch (const std::exception &e) {
+        std::cerr << "Failed to update epoll events for client " << client_fd << ": " << e.what() << std::endl;
+    }
+}
 
 void TCPServer::disconnectClient(int client_fd) {
     auto it = m_clients.find(client_fd);
@@ -439,23 +999,21 @@ void TCPServer::disconnectClient(int client_fd) {
         }
     }
 
-    if (::close(client_fd) == -1) {
+    if (m_transport->close(client_fd) == -1) {
         std::cerr << "Error closing client socket " << client_fd << ":" << strerror(errno) << std::endl;
     }
 
+    // The fd number may be reused by the next accept, it must not be resumed
+    if (it->second.readQueued) {
+        std::erase(m_readyClients, client_fd);
+    }
     m_clients.erase(it);
     std::cout << "Client " << client_fd << " disconnected successfully" << std::endl;
 }
-void TCPServer::handleNewConnection() {
+void TCPServer::handleNewConnection(int listen_fd) {
     while (true) {
-        sockaddr_in client_addr{};
-        socklen_t addr_len = sizeof(client_addr);
-        int client_fd = accept4(
-            m_server_fd,
-            reinterpret_cast<sockaddr*>(&client_addr),
-            &addr_len,
-            SOCK_NONBLOCK
-            );
+        PeerAddress client_addr;
+        int client_fd = m_transport->accept(listen_fd, client_addr);
         if (client_fd == -1) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
                 break;
@@ -465,104 +1023,161 @@ void TCPServer::handleNewConnection() {
             }
         }
 
-        m_clients[client_fd] = client_addr;
+        ClientState& client = m_clients[client_fd];
+        client.addr = client_addr;
+        client.admin = listen_fd == m_admin_fd;
+        client.stats.connectedAt = LoopClock::now();
+        client.stats.lastActivity = client.stats.connectedAt;
 
         try {
-            m_epollManager->addFD(client_fd, EPOLLIN | EPOLLET | EPOLLRDHUP);
-            char client_ip[INET_ADDRSTRLEN];
-            inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, sizeof(client_ip));
-            int client_port = ntohs(client_addr.sin_port);
-            std::cout << "New TCP client connected: " << client_ip << ":" << client_port
+            m_epollManager->addFD(client_fd, CLIENT_EVENTS);
+            std::cout << "New TCP client connected: " << client_addr.toString()
             << " (fd: " << client_fd << ")" << std::endl;
             if (m_connectCallback) {
                 m_connectCallback(client_fd, client_addr);
             }
         } catch (const std::exception &e) {
             std::cerr << "Failed to add client to epoll: " << e.what() << std::endl;
-            ::close(client_fd);
+            m_transport->close(client_fd);
             m_clients.erase(client_fd);
         }
     }
 }
 void TCPServer::handleClientData(int client_fd) {
-    constexpr size_t BUFFER_SIZE = 1024;
-    char buffer[BUFFER_SIZE];
-    while (true) {
-        ssize_t bytes_read = recv(client_fd, buffer, BUFFER_SIZE - 1, 0);
-        if (bytes_read > 0) {
-            buffer[bytes_read] = '\0';
-            std::string message(buffer);
-
-            if (m_dataCallback) {
-                m_dataCallback(client_fd, message);
-            }
-        } else if (bytes_read == 0) {
-            disconnectClient(client_fd);
-            break;
-        } else {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                break;
-            } else {
-                disconnectClient(client_fd);
-                break;
-            }
-        }
-
-    }
+    CallbackHandler handler{m_dataCallback};
+    handleClientData(client_fd, handler);
 }
 AsyncServer::AsyncServer(const std::string &serverIP, int port)
 : m_serverIP(serverIP)
 , m_serverPort(port) {
     m_epollManager = std::make_unique<EPollManager>();
     m_udpServer = std::make_unique<UDPServer>();
+    m_unixUdpServer = std::make_unique<UDPServer>();
     m_tcpServer = std::make_unique<TCPServer>();
     m_serverStats = std::make_unique<ServerStats>();
     m_commandProcessor = std::make_unique<CommandProcessor>();
+    m_pubSub = std::make_unique<PubSub>(m_tcpServer.get());
+    m_keyValueStore = std::make_unique<KeyValueStore>();
+    m_statsPublisher = std::make_unique<StatsPublisher>();
+    m_capture = std::make_unique<TrafficCapture>();
+    m_fileCache = std::make_unique<FileCache>();
+    m_upstreams = std::make_unique<UpstreamPool>(m_tcpServer.get());
+    m_udpServer->setStats(m_serverStats.get());
+    m_unixUdpServer->setStats(m_serverStats.get());
+    m_tcpServer->setStats(m_serverStats.get());
 
     setupCallbacks();
     setupCommandProcessor();
 }
 AsyncServer::~AsyncServer() {
     shutdown();
+    // Disconnect callbacks reach sessions and stats, stop clients while they are alive
+    if (m_tcpServer) {
+        m_tcpServer->stop();
+    }
+    if (m_traceDumper.joinable()) {
+        m_traceDumper.join();
+    }
 }
 void AsyncServer::runEventLoop() {
     constexpr size_t MAX_EVENTS = 64;
     constexpr size_t EPOLL_TIMEOUT_MS = 100;
+    constexpr auto STATS_PUBLISH_INTERVAL = std::chrono::milliseconds(100);
+    // Posted tasks run per iteration, so a flood of posts cannot starve the sockets
+    constexpr size_t MAX_TASKS_PER_ITERATION = 256;
 
     epoll_event events[MAX_EVENTS];
+    LoopStats& loopStats = m_serverStats->getLoopStats();
 
     int tcp_server_fd = m_tcpServer->getFD();
     int udp_server_fd = m_udpServer->getFD();
+    int unix_stream_fd = m_tcpServer->getUnixFD();
+    int unix_dgram_fd = m_unixUdpServer->getFD();
+    int admin_fd = m_tcpServer->getAdminFD();
+    int wakeup_fd = m_epollManager->getWakeupFD();
+    bool tasks_left = true;
 
     std::cout << "Starting event loop. TCP server fd: " << tcp_server_fd
               << ", UDP server fd: " << udp_server_fd << std::endl;
 
+    if (m_busyPoll.enabled) {
+        applyBusyPoll();
+    }
+    auto woke_up = LoopClock::now();
+    auto last_activity = woke_up;
+    auto last_published = woke_up;
+
     while (m_running) {
-        int event_count = m_epollManager->waitForEvents(events, MAX_EVENTS, EPOLL_TIMEOUT_MS);
+        int timeout = m_sessionManager ? m_sessionManager->nextTimeout(EPOLL_TIMEOUT_MS) : EPOLL_TIMEOUT_MS;
+        if (m_pubSub->hasPending() || tasks_left || m_tcpServer->hasReadyClients()) {
+            timeout = 0;
+        }
+        // Busy poll: spin while events keep coming, block again after an idle period
+        bool spin = m_busyPoll.enabled && timeout != 0 && woke_up - last_activity < m_busyPoll.idleBeforeBlocking;
+        if (spin) {
+            timeout = 0;
+        }
+        auto wait_started = LoopClock::now();
+        int event_count = m_epollManager->waitForEvents(events, MAX_EVENTS, timeout);
+        woke_up = LoopClock::now();
+        loopStats.recordWait(elapsedNs(wait_started, woke_up), event_count);
+        if (m_busyPoll.enabled) {
+            loopStats.recordPoll(spin, event_count);
+            if (event_count > 0) {
+                last_activity = woke_up;
+            }
+        }
+
+        if (event_count > 1 && admin_fd != -1) {
+            // Priority lane: the admin listener and its connections go ahead of the rest of the batch
+            auto priority_end = std::stable_partition(events, events + event_count, [&](const epoll_event& event) {
+                return event.data.fd == admin_fd || m_tcpServer->isAdmin(event.data.fd);
+            });
+            loopStats.recordPriorityEvents(static_cast<uint64_t>(priority_end - events));
+        }
 
         for (int i = 0; i < event_count; ++i) {
             int fd = events[i].data.fd;
             uint32_t event_mask = events[i].events;
+            auto started = LoopClock::now();
 
-            if (fd == tcp_server_fd) {
+            if (fd == wakeup_fd) {
+                m_epollManager->clearWakeup();
+                tasks_left = true;
+            } else if (fd == tcp_server_fd || fd == unix_stream_fd || fd == admin_fd) {
                 std::cout << "TCP server socket event" << std::endl;
                 if (event_mask & EPOLLIN) {
-                    m_tcpServer->handleNewConnection();
+                    m_tcpServer->handleNewConnection(fd);
                 }
                 if (event_mask & EPOLLERR) {
                     std::cerr << "TCP server socket error" << std::endl;
                 }
-            } else if (fd == udp_server_fd) {
+                started = finishHandler(LoopHandler::Accept, fd, started);
+            } else if (fd == udp_server_fd || fd == unix_dgram_fd) {
                 std::cout << "UDP server socket event" << std::endl;
+                UDPServer& udpServer = fd == udp_server_fd ? *m_udpServer : *m_unixUdpServer;
                 if (event_mask & EPOLLIN) {
-                    m_udpServer->handleMessage();
+                    udpServer.handleMessage(*this);
+                    started = finishHandler(LoopHandler::UdpRead, fd, started);
+                }
+                if (event_mask & EPOLLOUT) {
+                    udpServer.handleWritable();
+                    started = finishHandler(LoopHandler::UdpWrite, fd, started);
                 }
                 if (event_mask & EPOLLERR) {
                     std::cerr << "UDP server socket error" << std::endl;
                 }
+            } else if (!m_upstreams->empty() && m_upstreams->owns(fd)) {
+                m_upstreams->handleEvent(fd, event_mask);
+                started = finishHandler(LoopHandler::Upstream, fd, started);
             } else {
                 if (event_mask & (EPOLLIN | EPOLLRDHUP)) {
-                    m_tcpServer->handleClientData(fd);
+                    m_tcpServer->handleClientData(fd, *this);
+                    started = finishHandler(LoopHandler::TcpRead, fd, started);
+                }
+                if (event_mask & EPOLLOUT) {
+                    m_tcpServer->handleWritable(fd);
+                    started = finishHandler(LoopHandler::TcpWrite, fd, started);
                 }
                 if (event_mask & EPOLLERR) {
                     std::cerr << "TCP client socket " << fd << " error" << std::endl;
@@ -575,7 +1190,103 @@ void AsyncServer::runEventLoop() {
                 }
             }
         }
+
+        // Every fd of the batch has had its turn, now the clients that hit the read budget go again
+        if (m_tcpServer->hasReadyClients()) {
+            auto resume_started = LoopClock::now();
+            m_tcpServer->resumeReads(*this);
+            finishHandler(LoopHandler::TcpRead, -1, resume_started);
+        }
+
+        if (tasks_left) {
+            auto tasks_started = LoopClock::now();
+            tasks_left = m_tasks.runPending(MAX_TASKS_PER_ITERATION);
+            finishHandler(LoopHandler::Tasks, -1, tasks_started);
+        }
+
+        auto timers_started = LoopClock::now();
+        if (m_sessionManager) {
+            m_sessionManager->runTimers();
+        }
+        m_pubSub->runPending();
+        m_upstreams->runTimers();
+        if (m_keyValueStore->expireCycle() > 0) {
+            m_serverStats->setKeyValueStats(m_keyValueStore->getStats());
+        }
+        if (m_statsPublisher->isOpen() && woke_up - last_published >= STATS_PUBLISH_INTERVAL) {
+            m_statsPublisher->publish(*m_serverStats);
+            last_published = woke_up;
+        }
+        if (Tracer::takeDumpRequest()) {
+            startTraceDump();
+        }
+        auto finished = finishHandler(LoopHandler::Timers, -1, timers_started);
+        loopStats.recordBusy(elapsedNs(woke_up, finished));
+    }
+}
+void AsyncServer::startTraceDump() {
+    if (m_traceDumping.exchange(true)) {
+        std::cerr << "Trace dump already in progress, request ignored" << std::endl;
+        return;
+    }
+    if (m_traceDumper.joinable()) {
+        m_traceDumper.join();
+    }
+    m_traceDumper = std::thread([this]() {
+        size_t traced = 0;
+        if (Tracer::dumpChromeTrace(Tracer::DEFAULT_DUMP_PATH, traced)) {
+            std::cout << "Trace dumped to " << Tracer::DEFAULT_DUMP_PATH << " (" << traced << " spans)" << std::endl;
+        }
+        m_traceDumping.store(false);
+    });
+}
+void AsyncServer::applyBusyPoll() {
+    if (m_busyPoll.cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(m_busyPoll.cpu, &cpus);
+        int res = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (res != 0) {
+            std::cerr << "Failed to pin reactor thread to CPU " << m_busyPoll.cpu << ": " << strerror(res) << std::endl;
+        } else {
+            std::cout << "Reactor thread pinned to CPU " << m_busyPoll.cpu << std::endl;
+        }
+    }
+
+    if (m_busyPoll.socketBusyPollUs > 0) {
+        // Accepted clients inherit SO_BUSY_POLL from the listening socket
+        int usecs = m_busyPoll.socketBusyPollUs;
+        for (int fd : {m_tcpServer->getFD(), m_udpServer->getFD()}) {
+            if (fd != -1 && ::setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs)) == -1) {
+                std::cerr << "setsockopt(SO_BUSY_POLL) failed on fd " << fd << ": " << strerror(errno) << std::endl;
+            }
+        }
+        m_epollManager->setBusyPoll(usecs, 8);
+    }
+    std::cout << "Busy poll enabled, blocking after "
+              << m_busyPoll.idleBeforeBlocking.count() << " us without events" << std::endl;
+}
+LoopClock::time_point AsyncServer::finishHandler(LoopHandler handler, int fd, LoopClock::time_point started) {
+    auto finished = LoopClock::now();
+    uint64_t ns = elapsedNs(started, finished);
+    LoopStats& loopStats = m_serverStats->getLoopStats();
+    loopStats.recordHandler(handler, ns);
+
+    if (ns >= loopStats.getSlowThresholdNs()) {
+        loopStats.slowCallback();
+        std::cerr << "Slow callback: " << loopHandlerName(handler) << " fd " << fd
+                  << " took " << ns / 1000 << " us";
+        if (m_currentCommandLength > 0) {
+            std::cerr << ", last command: " << std::string_view(m_currentCommand.data(), m_currentCommandLength);
+        }
+        std::cerr << std::endl;
     }
+    m_currentCommandLength = 0;
+    return finished;
+}
+void AsyncServer::trackCommand(const std::string &command) {
+    m_currentCommandLength = std::min(command.size(), m_currentCommand.size());
+    std::memcpy(m_currentCommand.data(), command.data(), m_currentCommandLength);
 }
 void AsyncServer::exec() {
     std::cout << "AsyncServer::exec - Starting server..." << std::endl;
@@ -583,23 +1294,81 @@ void AsyncServer::exec() {
         std::cout << "Server is already running" << std::endl;
         return;
     }
+    if (m_loopback) {
+        if (!m_tcpServer->attach(m_loopback->getListenFD(), m_epollManager.get(), m_loopback)) {
+            std::cerr << "Failed to attach TCP server to the loopback transport" << std::endl;
+            return;
+        }
+        if (!m_udpServer->attach(m_loopback->getDatagramFD(), m_epollManager.get(), m_loopback)) {
+            std::cerr << "Failed to attach UDP server to the loopback transport" << std::endl;
+            return;
+        }
+    } else if (!startListeners()) {
+        return;
+    }
+
+    if (!m_capturePath.empty()) {
+        m_capture->start(m_capturePath);
+    }
+    if (!m_loopback) {
+        m_upstreams->start(m_epollManager.get());
+    } else if (!m_upstreams->empty()) {
+        std::cerr << "Upstreams need kernel sockets, they are disabled on the loopback transport" << std::endl;
+    }
+    if (!m_statsSegmentName.empty() && m_statsPublisher->open(m_statsSegmentName)) {
+        m_statsPublisher->publish(*m_serverStats);
+    }
+    m_epollManager->enableWakeup();
+    std::signal(SIGUSR1, onTraceDumpSignal);
+    if (!m_loopback) {
+        startConsoleHandler();
+    }
+    m_running = true;
+    std::cout << "AsyncServer started successfully on "
+              << (m_loopback ? std::string("loopback") : m_serverIP + ":" + std::to_string(m_serverPort)) << std::endl;
+    runEventLoop();
+}
+bool AsyncServer::startListeners() {
     if (!m_tcpServer->start(m_serverIP, m_serverPort, m_epollManager.get())) {
         std::cerr << "Failed to start TCP server: " << std::endl;
-        return;
+        return false;
     }
     if (!m_udpServer->start(m_serverIP, m_serverPort, m_epollManager.get())) {
         std::cerr << "Failed to start UDP server: " << std::endl;
-        return;
+        return false;
     }
-
-    startConsoleHandler();
-    m_running = true;
-    std::cout << "AsyncServer started successfully on " << m_serverIP << ":" << m_serverPort << std::endl;
-    runEventLoop();
+    if (m_adminPort > 0 && !m_tcpServer->listenAdmin(m_serverIP, m_adminPort)) {
+        std::cerr << "Failed to start admin listener on port " << m_adminPort << std::endl;
+    }
+    if (!m_unixSocketPath.empty()) {
+        // Local clients are optional, the network listeners keep working without them
+        if (!m_tcpServer->listenUnix(m_unixSocketPath)) {
+            std::cerr << "Failed to start unix stream listener on " << m_unixSocketPath << std::endl;
+        }
+        if (!m_unixUdpServer->startUnix(m_unixSocketPath + ".dgram", m_epollManager.get())) {
+            std::cerr << "Failed to start unix datagram server on " << m_unixSocketPath << ".dgram" << std::endl;
+        }
+    }
+    return true;
 }
 void AsyncServer::shutdown() {
     std::cout << "AsyncServer::shutdown - Initiating shutdown..." << std::endl;
     m_running = false;
+    m_epollManager->wakeup();
+}
+void AsyncServer::post(TaskQueue::Task task) {
+    m_tasks.push(std::move(task));
+    m_epollManager->wakeup();
+}
+void AsyncServer::postSend(int client_fd, std::string data) {
+    post([this, client_fd, data = std::move(data)]() {
+        m_tcpServer->sendData(client_fd, data);
+    });
+}
+void AsyncServer::postDisconnect(int client_fd) {
+    post([this, client_fd]() {
+        m_tcpServer->disconnectClient(client_fd);
+    });
 }
 
 void AsyncServer::startConsoleHandler() {
@@ -615,12 +1384,88 @@ void AsyncServer::stopConsoleHandler() {
 bool AsyncServer::isConsoleRunning() const {
     return m_commandProcessor ? m_commandProcessor->isConsoleRunning() : false;
 }
+void AsyncServer::setSessionHandler(SessionManager::Handler handler) {
+    if (m_running) {
+        std::cerr << "Session handler must be set before exec()" << std::endl;
+        return;
+    }
+    m_sessionManager = std::make_unique<SessionManager>(m_tcpServer.get(), std::move(handler));
+}
+void AsyncServer::setUnixSocketPath(const std::string &path) {
+    if (m_running) {
+        std::cerr << "Unix socket path must be set before exec()" << std::endl;
+        return;
+    }
+    m_unixSocketPath = path;
+}
+void AsyncServer::setSlowCallbackThreshold(std::chrono::microseconds threshold) {
+    m_serverStats->getLoopStats().setSlowThresholdNs(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(threshold).count());
+}
+bool AsyncServer::setFileDirectory(const std::string &directory) {
+    return m_fileCache->setRoot(directory);
+}
+void AsyncServer::setCaptureFile(const std::string &path) {
+    if (m_running) {
+        std::cerr << "Capture file must be configured before exec()" << std::endl;
+        return;
+    }
+    m_capturePath = path;
+}
+void AsyncServer::setStatsSegment(const std::string &name) {
+    if (m_running) {
+        std::cerr << "Stats segment must be configured before exec()" << std::endl;
+        return;
+    }
+    m_statsSegmentName = name;
+}
+void AsyncServer::setLoopback(std::unique_ptr<LoopbackTransport> loopback) {
+    if (m_running) {
+        std::cerr << "Loopback transport must be configured before exec()" << std::endl;
+        return;
+    }
+    m_loopback = loopback.get();
+    m_epollManager = std::move(loopback);
+}
+bool AsyncServer::addUpstream(const UpstreamConfig &config) {
+    if (m_running) {
+        std::cerr << "Upstreams must be configured before exec()" << std::endl;
+        return false;
+    }
+    return m_upstreams->addBackend(config);
+}
+void AsyncServer::setAdminPort(int port) {
+    if (m_running) {
+        std::cerr << "Admin port must be configured before exec()" << std::endl;
+        return;
+    }
+    m_adminPort = port;
+}
+void AsyncServer::setReadBudget(const ReadBudget &budget) {
+    if (m_running) {
+        std::cerr << "Read budget must be configured before exec()" << std::endl;
+        return;
+    }
+    m_tcpServer->setReadBudget(budget);
+}
+void AsyncServer::setTraceSampling(uint32_t every) {
+    Tracer::setSampleEvery(every);
+}
+void AsyncServer::setBusyPoll(const BusyPollConfig &config) {
+    if (m_running) {
+        std::cerr << "Busy poll must be configured before exec()" << std::endl;
+        return;
+    }
+    m_busyPoll = config;
+    m_serverStats->getLoopStats().setBusyPollEnabled(config.enabled);
+}
+void AsyncServer::setKeyValueMemoryLimit(size_t bytes) {
+    m_keyValueStore->setMaxMemory(bytes);
+    m_serverStats->setKeyValueStats(m_keyValueStore->getStats());
+}
 void AsyncServer::setupCallbacks() {
-    m_tcpServer->setDataCallback([this](int client_fd,  const std::string &message) {
-        this->handleTCPData(client_fd, message);
-    });
-
-    m_tcpServer->setConnectCallback([this](int client_fd, const sockaddr_in& addr) {
+    // Data and datagrams reach onTcpData / onUdpMessage through the handler policy in runEventLoop
+    m_tcpServer->setConnectCallback([this](int client_fd, const PeerAddress& addr) {
         this->handleTCPConnect(client_fd, addr);
     });
 
@@ -628,8 +1473,10 @@ void AsyncServer::setupCallbacks() {
         this->handleTCPDisconnect(client_fd);
     });
 
-    m_udpServer->setMessageCallback([this](const std::string &message, const sockaddr_in& addr) {
-        this->handleUDPData(message, addr);
+    m_tcpServer->setDrainCallback([this](int client_fd) {
+        if (m_sessionManager) {
+            m_sessionManager->onDrain(client_fd);
+        }
     });
 }
 void AsyncServer::setupCommandProcessor() {
@@ -642,54 +1489,210 @@ void AsyncServer::setupCommandProcessor() {
     m_commandProcessor->setStatsCallbacks([this]() {
         return CommandProcessor::formatStats(*m_serverStats);
     });
-}
 
-void AsyncServer::handleTCPConnect(int client_fd, const sockaddr_in &addr) {
-    char client_ip[INET_ADDRSTRLEN];
-    inet_ntop(AF_INET, &addr.sin_addr, client_ip, INET_ADDRSTRLEN);
-    int client_port = ntohs(addr.sin_port);
+    m_commandProcessor->setClientsCallback([this](size_t count, bool byBytes) {
+        return formatTopClients(count, byBytes);
+    });
 
+    m_commandProcessor->setUpstreamsCallback([this]() {
+        return m_upstreams->formatStats();
+    });
+
+    m_commandProcessor->setKeyValueStore(m_keyValueStore.get());
+    m_serverStats->setKeyValueStats(m_keyValueStore->getStats());
+}
+
+std::string AsyncServer::formatTopClients(size_t count, bool byBytes) const {
+    std::vector<ClientStatsRow> rows;
+    m_tcpServer->collectClientStats(rows);
+    count = std::min(count, rows.size());
+    // Only the top N rows get ordered, the rest of the table is left as is
+    std::partial_sort(rows.begin(), rows.begin() + static_cast<std::ptrdiff_t>(count), rows.end(),
+                      [byBytes](const ClientStatsRow& a, const ClientStatsRow& b) {
+                          return byBytes ? a.bytes > b.bytes : a.requestRate > b.requestRate;
+                      });
+
+    const auto now = LoopClock::now();
+    std::ostringstream oss;
+    oss << "Top " << count << " of " << rows.size() << " clients by " << (byBytes ? "bytes" : "request rate") << ":";
+    oss << std::fixed << std::setprecision(1);
+    for (size_t i = 0; i < count; ++i) {
+        const ClientStatsRow& row = rows[i];
+        const ClientStats& stats = *row.stats;
+        oss << "\n\tfd " << row.fd << " " << m_tcpServer->getClientAddress(row.fd)
+            << ": " << row.requests << " requests (" << row.requestRate << "/s)"
+            << ", in " << stats.bytesIn << " B, out " << stats.bytesOut << " B"
+            << ", latency p50 < " << stats.latency.quantileUs(0.5) << " us, p99 < " << stats.latency.quantileUs(0.99) << " us"
+            << ", idle " << std::chrono::duration_cast<std::chrono::milliseconds>(now - stats.lastActivity).count() << " ms";
+    }
+    return oss.str();
+}
+void AsyncServer::handleTCPConnect(int client_fd, const PeerAddress &addr) {
     std::cout << "AsyncServer::handleTCPConnect - Client connected: "
-                  << client_ip << ":" << client_port << " (fd: " << client_fd << ")" << std::endl;
+                  << addr.toString() << " (fd: " << client_fd << ")" << std::endl;
     m_serverStats->clientConnected();
+    m_capture->tcpOpen(client_fd);
+    if (m_sessionManager) {
+        m_sessionManager->onConnect(client_fd);
+    }
 }
 void AsyncServer::handleTCPData(int client_fd, const std::string &data) {
     std::cout << "AsyncServer::handleTCPData from client " << client_fd << ": " << data << std::endl;
-    std::string response;
-    std::string trimmedData = trimNetworkData(data);
-    if (!trimmedData.empty() && trimmedData[0] == '/') {
-        // for processor commands
-        std::string command = trimmedData;
-        response = m_commandProcessor->processCommand(command, *m_serverStats);
-        if (response == "SHUTDOWN") {
-            m_tcpServer->sendData(client_fd, "Server shutting down...");
-            shutdown();
+    m_capture->tcpData(client_fd, data);
+    if (m_sessionManager) {
+        m_sessionManager->onData(client_fd, data);
+        return;
+    }
+    // Every '\n'-terminated line is a request. A line may span reads, the bytes after the last
+    // '\n' wait in the client's input tail and are put in front of the next read.
+    std::string* tail = m_tcpServer->getInputTail(client_fd);
+    if (!tail) {
+        return;
+    }
+    std::string joined;
+    std::string_view rest(data);
+    if (!tail->empty()) {
+        joined = std::move(*tail);
+        tail->clear();
+        joined += data;
+        rest = joined;
+    }
+    while (!rest.empty()) {
+        std::string_view frame;
+        {
+            TraceSpan span(TraceStage::Parse, client_fd);
+            size_t newline = TextScan::find(rest, '\n');
+            if (newline == std::string_view::npos) {
+                break;
+            }
+            frame = TextScan::trimRight(rest.substr(0, newline));
+            rest = rest.substr(newline + 1);
+        }
+        if (frame.empty()) {
+            continue;
+        }
+        if (!handleTCPFrame(client_fd, frame) || !m_tcpServer->hasClient(client_fd)) {
             return;
         }
-    } else {
-        response = trimmedData;
+    }
+    if (!rest.empty()) {
+        if (rest.size() > MAX_TCP_LINE_BYTES) {
+            std::cerr << "TCP client " << client_fd << " sent " << rest.size() << " bytes without a newline, disconnecting" << std::endl;
+            m_tcpServer->sendData(client_fd, "ERR line too long\n");
+            m_tcpServer->disconnectClient(client_fd);
+            return;
+        }
+        m_tcpServer->getInputTail(client_fd)->assign(rest);
+    }
+}
+bool AsyncServer::handleTCPFrame(int client_fd, std::string_view frame) {
+    // Control commands stay local whatever the routes are, the server must remain manageable
+    if (!m_upstreams->empty() && !CommandProcessor::isControlCommand(frame) && m_upstreams->forward(client_fd, frame)) {
+        return true;
+    }
+    // Replies are '\n'-terminated too, so a client pipelining requests can tell them apart
+    if (!TextScan::isCommand(frame)) {
+        std::string reply;
+        reply.reserve(frame.size() + 1);
+        reply.append(frame);
+        reply.push_back('\n');
+        m_tcpServer->sendData(client_fd, reply);
+        return true;
+    }
+
+    std::string command(frame);
+    trackCommand(command);
+    TraceSpan span(TraceStage::Process, client_fd);
+    if (handleClientCommand(client_fd, command)) {
+        return true;
+    }
+    // for processor commands
+    std::string response = m_commandProcessor->processCommand(command, *m_serverStats);
+    if (response == "SHUTDOWN") {
+        m_tcpServer->sendData(client_fd, "Server shutting down...\n");
+        shutdown();
+        return false;
+    }
+    if (response.empty() || response.back() != '\n') {
+        response.push_back('\n');
     }
     m_tcpServer->sendData(client_fd, response);
+    return true;
 }
 void AsyncServer::handleTCPDisconnect(int client_fd) {
     std::cout << "AsyncServer::handleTCPDisconnect - Client disconnected: " << client_fd << std::endl;
     m_serverStats->clientDisconnected();
+    m_pubSub->removeClient(client_fd);
+    if (!m_upstreams->empty()) {
+        m_upstreams->removeClient(client_fd);
+    }
+    m_capture->tcpClose(client_fd);
+    if (m_sessionManager) {
+        m_sessionManager->onDisconnect(client_fd);
+    }
+}
+bool AsyncServer::handleClientCommand(int client_fd, const std::string &command) {
+    // Commands bound to the connection itself, the rest goes to CommandProcessor
+    size_t name_end = command.find(' ');
+    std::string name = command.substr(0, name_end);
+    std::string args = name_end == std::string::npos ? "" : command.substr(name_end + 1);
+
+    if (name == "/subscribe" || name == "/unsubscribe") {
+        if (args.empty() || args.find(' ') != std::string::npos) {
+            m_tcpServer->sendData(client_fd, "Usage: " + name + " <topic>\n");
+        } else if (name == "/subscribe") {
+            m_pubSub->subscribe(client_fd, args);
+            m_tcpServer->sendData(client_fd, "Subscribed to " + args + "\n");
+        } else {
+            bool removed = m_pubSub->unsubscribe(client_fd, args);
+            m_tcpServer->sendData(client_fd, (removed ? "Unsubscribed from " : "Not subscribed to ") + args + "\n");
+        }
+        return true;
+    }
+    if (name == "/get-file") {
+        std::string error;
+        auto file = m_fileCache->open(args, error);
+        if (!file) {
+            m_tcpServer->sendData(client_fd, "ERR " + error + "\n");
+            return true;
+        }
+        // Size line first so the client knows where the file ends
+        if (m_tcpServer->sendData(client_fd, "FILE " + std::to_string(file->size) + "\n")) {
+            m_tcpServer->sendFile(client_fd, std::move(file));
+        }
+        return true;
+    }
+    if (name == "/publish") {
+        size_t topic_end = args.find(' ');
+        if (args.empty() || topic_end == 0 || topic_end == std::string::npos) {
+            m_tcpServer->sendData(client_fd, "Usage: /publish <topic> <message>\n");
+            return true;
+        }
+        size_t delivered = m_pubSub->publish(args.substr(0, topic_end), args.substr(topic_end + 1));
+        m_tcpServer->sendData(client_fd, "Published to " + std::to_string(delivered) + " subscribers\n");
+        return true;
+    }
+    return false;
 }
 
-void AsyncServer::handleUDPData(const std::string data, const sockaddr_in &addr) {
-    char client_ip[INET_ADDRSTRLEN];
-    inet_ntop(AF_INET, &addr.sin_addr, client_ip, sizeof(client_ip));
-    int client_port = ntohs(addr.sin_port);
-
-    std::cout << "AsyncServer::handleUDPData from " << client_ip << ":" << client_port  << ": " << data << std::endl;
+void AsyncServer::handleUDPData(UDPServer& server, const std::string& data, const PeerAddress &addr) {
+    std::cout << "AsyncServer::handleUDPData from " << addr.toString() << ": " << data << std::endl;
+    m_capture->udpData(std::string_view(reinterpret_cast<const char*>(&addr.storage), addr.length), data);
 
     std::string response;
-    if (!data.empty() && data[0] != '/') {
+    std::string_view trimmedData;
+    {
+        TraceSpan span(TraceStage::Parse, server.getFD());
+        trimmedData = TextScan::trimRight(data);
+    }
+    if (TextScan::isCommand(trimmedData)) {
         // to command processor
-        std::string command = data;
+        std::string command(trimmedData);
+        trackCommand(command);
+        TraceSpan span(TraceStage::Process, server.getFD());
         response = m_commandProcessor->processCommand(command, *m_serverStats);
-        if (response.find("SHUTDOWN")) {
-            m_udpServer->sendResponse(addr, "Server shutting down...");
+        if (response == "SHUTDOWN") {
+            server.sendResponse(addr, "Server shutting down...");
             shutdown();
             return;
         }
@@ -697,18 +1700,7 @@ void AsyncServer::handleUDPData(const std::string data, const sockaddr_in &addr)
         response = data;
     }
 
-    m_udpServer->sendResponse(addr, response);
-}
-std::string AsyncServer::trimNetworkData(const std::string &data)  {
-    if (data.empty()) return data;
-
-    size_t end = data.length();
-
-    while (end > 0 && (data[end-1] == '\n' || data[end-1] == '\r' || data[end-1] == ' ' || data[end-1] == '\t')) {
-        end--;
-    }
-
-    return data.substr(0, end);
+    server.sendResponse(addr, response);
 }
 void AsyncServer::gracefulShutdown() {
     std::cout << "AsyncServer::gracefulShutdown - Performing graceful shutdown..." << std::endl;
@@ -728,5 +1720,13 @@ void AsyncServer::gracefulShutdown() {
         m_udpServer->stop();
     }
 
+    if (m_unixUdpServer) {
+        m_unixUdpServer->stop();
+    }
+
+    if (m_capture) {
+        m_capture->stop();
+    }
+
     std::cout << "AsyncServer shutdown complete" << std::endl;
 }
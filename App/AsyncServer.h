@@ -5,31 +5,142 @@
 #ifndef ASYNCSERVER_ASYNCSERVER_H
 #define ASYNCSERVER_ASYNCSERVER_H
 
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <concepts>
+#include <cstring>
+#include <deque>
 #include <functional>
+#include <iostream>
 #include <memory>
+#include <string_view>
 #include <sys/epoll.h>
+#include <thread>
 
 #include <netinet/in.h>
+#include <sys/socket.h>
 #include <unordered_map>
+#include <vector>
 #include "CommandProcessor.h"
 #include "ServerStats.h"
+#include "Session.h"
+#include "TaskQueue.h"
+#include "Tracer.h"
+#include "Transport.h"
 
+class KeyValueStore;
+class PubSub;
+class FileCache;
+class StatsPublisher;
+class TrafficCapture;
+class UpstreamPool;
+class LoopbackTransport;
 
+using LoopClock = std::chrono::steady_clock;
+
+inline uint64_t elapsedNs(LoopClock::time_point from, LoopClock::time_point to) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+}
+
+
+// Readiness source of the reactor. Virtual so that LoopbackTransport can simulate it in process.
 class EPollManager {
 public:
     EPollManager();
     EPollManager(const EPollManager&) = delete;
     EPollManager& operator=(const EPollManager&) = delete;
-    ~EPollManager();
+    virtual ~EPollManager();
 
-    void addFD(int fd, uint32_t events);
-    void modifyFD(int fd, uint32_t events);
-    void removeFD(int fd) const;
-    int waitForEvents(epoll_event* events, int maxEvents, int timeout = -1);
+    virtual void addFD(int fd, uint32_t events);
+    virtual void modifyFD(int fd, uint32_t events);
+    virtual void removeFD(int fd);
+    virtual int waitForEvents(epoll_event* events, int maxEvents, int timeout = -1);
+    // Kernel-side busy polling for this epoll instance (EPIOCSPARAMS, Linux 6.9+)
+    bool setBusyPoll(uint32_t usecs, uint16_t budget);
+    // eventfd registered in this epoll set; wakeup() makes waitForEvents return from any thread
+    virtual int enableWakeup();
+    virtual void wakeup();
+    // Reactor side, before handling the work the wakeup announced
+    virtual void clearWakeup();
+    int getWakeupFD() const { return m_wakeup_fd; }
     int getFD() const { return m_epoll_fd; }
     bool isValid() const { return m_epoll_fd != -1; }
-private:
+protected:
+    // For simulated readiness sources: no epoll instance is created
+    struct Simulated {};
+    explicit EPollManager(Simulated) {}
+
     int m_epoll_fd = -1;
+    int m_wakeup_fd = -1;
+    std::atomic<bool> m_wakeupPending{false};
+};
+
+// Peer of a TCP connection or a UDP datagram, AF_INET or AF_UNIX
+struct PeerAddress {
+    sockaddr_storage storage{};
+    socklen_t length = sizeof(sockaddr_storage);
+
+    sockaddr* get() { return reinterpret_cast<sockaddr*>(&storage); }
+    const sockaddr* get() const { return reinterpret_cast<const sockaddr*>(&storage); }
+    std::string toString() const;
+};
+
+// Per-connection counters kept in the client table
+struct ClientStats {
+    uint64_t bytesIn = 0;
+    uint64_t bytesOut = 0;
+    uint64_t requests = 0;
+    LoopClock::time_point connectedAt;
+    LoopClock::time_point lastActivity;
+    LatencySketch latency;  // time spent handling each read
+};
+
+// Flat copy of one client's counters for sorting; the address is looked up only for rows shown
+struct ClientStatsRow {
+    int fd = -1;
+    uint64_t bytes = 0;
+    uint64_t requests = 0;
+    double requestRate = 0;  // per second since connect
+    const ClientStats* stats = nullptr;
+};
+
+struct CachedFile;
+class UDPServer;
+
+// Handler policies for the receive loops. The handler type is a template parameter, so
+// recv -> dispatch is a direct, inlinable call instead of a std::function hop per message.
+template<typename Handler>
+concept TcpDataHandler = requires(Handler& handler, int client_fd, const std::string& data) {
+    handler.onTcpData(client_fd, data);
+};
+template<typename Handler>
+concept UdpMessageHandler = requires(Handler& handler, UDPServer& server, const std::string& data,
+                                     const PeerAddress& addr) {
+    handler.onUdpMessage(server, data, addr);
+};
+
+// Opt-in low-latency mode: the reactor spins on zero-timeout epoll_wait while traffic flows
+struct BusyPollConfig {
+    bool enabled = false;
+    int cpu = -1;                                         // core to pin the reactor thread to, -1 - no pinning
+    std::chrono::microseconds idleBeforeBlocking{50000};  // back off to blocking waits after this long without events
+    int socketBusyPollUs = 0;                             // SO_BUSY_POLL / epoll busy poll, 0 - off
+};
+
+// Proxy route: TCP frames starting with prefix are answered by the backend at host:port
+struct UpstreamConfig {
+    std::string prefix;
+    std::string host;
+    int port = 0;
+    size_t connections = 4;    // persistent connections, requests are pipelined over them
+};
+
+// How much one connection may read per loop iteration before yielding to the others, 0 - no limit
+struct ReadBudget {
+    size_t bytes = 64 * 1024;
+    size_t reads = 64;          // recv calls, each handed to the data handler
 };
 
 struct ServerInfo {
@@ -55,7 +166,7 @@ public:
         sockaddr_in clientAddr;
         time_t timestamp;
     };
-    using MessageCallback = std::function<void(const std::string& data, const sockaddr_in & addr)>;
+    using MessageCallback = std::function<void(const std::string& data, const PeerAddress & addr)>;
     UDPServer() = default;
     UDPServer(const UDPServer&) = delete;
     UDPServer(const UDPServer&&) = delete;
@@ -64,29 +175,71 @@ public:
     ~UDPServer();
 
     bool start(std::string& ip,int port, EPollManager *epollManager);
+    // AF_UNIX datagram socket bound to path (an existing socket file is replaced)
+    bool startUnix(const std::string& path, EPollManager *epollManager);
+    // Serve a datagram socket that already exists in the given transport instead of a kernel socket
+    bool attach(int fd, EPollManager *epollManager, Transport *transport);
     void stop();
     void setMessageCallback(MessageCallback cb) {m_messageCallback = std::move(cb); }
-    bool sendResponse(const sockaddr_in& clientAddr, const std::string& data);
+    void setStats(ServerStats* stats) { m_stats = stats; }
+    // Queues the datagram when the socket buffer is full; false only when it is dropped
+    bool sendResponse(const PeerAddress& clientAddr, const std::string& data);
     int getFD() const { return m_server_fd; }
     bool isRunning() const {return m_running; }
     void printServerInfo();
     ServerInfo getServerInfo();
 
-    void handleMessage() const;
+    template<UdpMessageHandler Handler>
+    void handleMessage(Handler& handler);
+    // Dispatches to the MessageCallback
+    void handleMessage();
+    void handleWritable();
+
+    // Adapts a MessageCallback to the handler policy
+    struct CallbackHandler {
+        const MessageCallback& callback;
+        void onUdpMessage(UDPServer&, const std::string& data, const PeerAddress& addr) const {
+            if (callback) callback(data, addr);
+        }
+    };
 
 private:
+    static constexpr size_t MAX_SEND_QUEUE = 4096;
+    static constexpr size_t SEND_BATCH = 64;
+    static constexpr uint32_t SERVER_EVENTS = EPOLLIN | EPOLLET;
+
+    struct PendingDatagram {
+        PeerAddress clientAddr;
+        std::string data;
+    };
+
+    bool registerSocket();
+    bool enqueueResponse(const PeerAddress& clientAddr, const std::string& data);
+    void setWriteInterest(bool enabled);
+    void updateQueueStats();
+
     int m_server_fd = -1;
     bool m_running = false;
     EPollManager * m_epollManager = nullptr;
+    Transport* m_transport = &SocketTransport::instance();
     MessageCallback m_messageCallback;
     ServerInfo m_serverInfo;
+    ServerStats* m_stats = nullptr;
+    std::string m_unixPath;
+
+    std::deque<PendingDatagram> m_sendQueue;
+    size_t m_reportedQueueDepth = 0;    // this server's share of ServerStats' UDP queue depth
+    bool m_writeArmed = false;
 };
 
 class TCPServer {
 public:
+    // Immutable payload that can sit in many client output queues at once
+    using SharedBuffer = std::shared_ptr<const std::string>;
     using DataCallback = std::function<void(int client_fd, const std::string& data)>;
-    using ConnectCallback = std::function<void(int client_fd, const sockaddr_in & addr)>;
+    using ConnectCallback = std::function<void(int client_fd, const PeerAddress & addr)>;
     using DisconnectCallback = std::function<void(int client_fd)>;
+    using DrainCallback = std::function<void(int client_fd)>;
 
     TCPServer() = default;
     TCPServer(const TCPServer&) = delete;
@@ -96,30 +249,116 @@ public:
     ~TCPServer();
 
     bool start(std::string& ip, int port, EPollManager *epollManager);
+    // Serve a listener that already exists in the given transport instead of a kernel socket
+    bool attach(int listen_fd, EPollManager *epollManager, Transport *transport);
+    // Additional AF_UNIX stream listener; its clients share the table and callbacks with TCP ones
+    bool listenUnix(const std::string& path);
+    // Additional TCP listener for operators; its clients are always in the priority lane
+    bool listenAdmin(const std::string& ip, int port);
     void stop();
 
     void setDataCallback(DataCallback cb) { m_dataCallback = std::move(cb); }
     void setConnectCallback(ConnectCallback cb) { m_connectCallback = std::move(cb); }
     void setDisconnectCallback(DisconnectCallback cb) { m_disconnectCallback = std::move(cb); }
+    // Output that had to wait for EPOLLOUT has been written out completely
+    void setDrainCallback(DrainCallback cb) { m_drainCallback = std::move(cb); }
+    void setReadBudget(const ReadBudget& budget) { m_readBudget = budget; }
+    void setStats(ServerStats* stats) { m_stats = stats; }
 
     bool sendData(int client_fd, const std::string& data);
+    bool sendShared(int client_fd, const SharedBuffer& data);
+    // Whole file via sendfile, queued behind pending output and paced by EPOLLOUT
+    bool sendFile(int client_fd, std::shared_ptr<const CachedFile> file);
     void disconnectClient(int client_fd);
+    bool hasClient(int client_fd) const { return m_clients.find(client_fd) != m_clients.end(); }
+    // Sent data or files still queued in user space, waiting for the socket to accept them
+    bool hasPendingOutput(int client_fd) const;
+    // Bytes after the last '\n' of earlier reads: a request still being received, nullptr for unknown clients
+    std::string* getInputTail(int client_fd);
+    // Rows stay valid until the client table changes
+    void collectClientStats(std::vector<ClientStatsRow>& rows) const;
+    std::string getClientAddress(int client_fd) const;
+    // Priority lane: events of admin listener clients are handled first and they have no read budget.
+    // Other clients are never promoted, the lane is chosen before their read shows what they sent.
+    bool isAdmin(int client_fd) const;
 
     int getFD() const { return m_server_fd; }
+    int getUnixFD() const { return m_unix_fd; }
+    int getAdminFD() const { return m_admin_fd; }
     bool isRunning() const { return m_running; }
-    void handleNewConnection();
+    void handleNewConnection(int listen_fd);
+    template<TcpDataHandler Handler>
+    void handleClientData(int client_fd, Handler& handler);
+    // Dispatches to the DataCallback
     void handleClientData(int client_fd);
+    void handleWritable(int client_fd);
+    // Clients that used up their read budget with data still pending in the socket.
+    // Edge-triggered epoll will not report them again, so the loop resumes them itself.
+    bool hasReadyClients() const { return !m_readyClients.empty(); }
+    template<TcpDataHandler Handler>
+    void resumeReads(Handler& handler);
+
+    // Adapts a DataCallback to the handler policy
+    struct CallbackHandler {
+        const DataCallback& callback;
+        void onTcpData(int client_fd, const std::string& data) const {
+            if (callback) callback(client_fd, data);
+        }
+    };
 private:
+    // Unsent output is kept per client and flushed on EPOLLOUT
+    static constexpr size_t MAX_OUTPUT_QUEUE_BYTES = 8 * 1024 * 1024;
+    static constexpr uint32_t CLIENT_EVENTS = EPOLLIN | EPOLLET | EPOLLRDHUP;
+
+    using FilePtr = std::shared_ptr<const CachedFile>;
+
+    // Memory buffer, or a file region the kernel copies with sendfile
+    struct OutputItem {
+        SharedBuffer buffer{};
+        FilePtr file{};
+        off_t fileOffset = 0;
+        size_t fileRemaining = 0;
+    };
+
+    struct ClientState {
+        PeerAddress addr;
+        std::deque<OutputItem> outQueue;
+        size_t outOffset = 0;        // bytes of outQueue.front().buffer already sent
+        size_t queuedBytes = 0;      // memory buffers only, file regions are not held in user space
+        std::string inputTail;       // unterminated line, completed by the next reads
+        bool writeArmed = false;
+        bool readQueued = false;     // on m_readyClients, reads wait for the resume pass
+        bool admin = false;          // accepted on the admin listener, served in the priority lane
+        ClientStats stats;
+    };
+
+    // false when the handler has disconnected the client
+    bool recordRequest(int client_fd, size_t bytes, LoopClock::time_point started);
+    void queueRead(int client_fd);
+
+    bool enqueueOutput(int client_fd, ClientState& client, SharedBuffer buffer, size_t offset);
+    bool enqueueFile(int client_fd, ClientState& client, FilePtr file, off_t offset);
+    bool flushOutput(int client_fd, ClientState& client);
+    void setWriteInterest(int client_fd, ClientState& client, bool enabled);
+
     int m_server_fd = -1;
+    int m_unix_fd = -1;
+    int m_admin_fd = -1;
+    std::string m_unixPath;
     bool m_running = false;
     EPollManager* m_epollManager = nullptr;
+    Transport* m_transport = &SocketTransport::instance();
 
-    std::unordered_map<int, sockaddr_in> m_clients;
+    std::unordered_map<int, ClientState> m_clients;
+    ReadBudget m_readBudget;
+    std::vector<int> m_readyClients;
+    std::vector<int> m_resuming;
+    ServerStats* m_stats = nullptr;
 
     DataCallback m_dataCallback;
     ConnectCallback m_connectCallback;
     DisconnectCallback m_disconnectCallback;
-
+    DrainCallback m_drainCallback;
 
 };
 
@@ -129,30 +368,192 @@ public:
     ~AsyncServer();
     void runEventLoop();
     void exec();
+    // Thread-safe, the loop stops on its next iteration
     void shutdown();
 
+    // Thread-safe way into the reactor: the task runs on the loop thread, in posting order.
+    // Reactor state (clients, stores, config) must only be touched from such tasks.
+    void post(TaskQueue::Task task);
+    void postSend(int client_fd, std::string data);
+    void postDisconnect(int client_fd);
+
     void startConsoleHandler();
     void stopConsoleHandler();
     bool isConsoleRunning() const;
+
+    // TCP clients are served by a coroutine per connection instead of the command path
+    void setSessionHandler(SessionManager::Handler handler);
+    // Memory cap of the /set, /get... cache; least recently used keys are evicted above it
+    void setKeyValueMemoryLimit(size_t bytes);
+    // Also serve local clients over AF_UNIX: stream socket at path, datagram socket at path + ".dgram"
+    void setUnixSocketPath(const std::string& path);
+    // Loop callbacks running longer than this are logged with their fd and command
+    void setSlowCallbackThreshold(std::chrono::microseconds threshold);
+    void setBusyPoll(const BusyPollConfig& config);
+    // Publish ServerStats to a shared memory segment (shm_open name, e.g. "/async-server-stats")
+    void setStatsSegment(const std::string& name);
+    // /get-file <name> serves regular files from this directory only
+    bool setFileDirectory(const std::string& directory);
+    // Record every inbound TCP frame and UDP datagram to a binary log for AsyncServerReplay
+    void setCaptureFile(const std::string& path);
+    // Forward matching TCP requests to a backend; see UpstreamPool for the reply protocol
+    bool addUpstream(const UpstreamConfig& config);
+    // Serve TCP and UDP clients of this in-process transport instead of sockets; exec() then runs the
+    // loop on the calling thread without the console or kernel listeners. See LoopbackTransport.
+    void setLoopback(std::unique_ptr<LoopbackTransport> loopback);
+    // Operator listener on the server address; its events are served before all other traffic.
+    // This is the only way into the priority lane, control commands on other connections wait their turn.
+    void setAdminPort(int port);
+    // Per-connection read limit per loop iteration, keeps one fast sender from starving the rest
+    void setReadBudget(const ReadBudget& budget);
+    // Trace one of every N reads, 0 - off. Dumped by /trace-dump or SIGUSR1
+    void setTraceSampling(uint32_t every);
+
+    // Handler policy used by the event loop for TCPServer / UDPServer
+    void onTcpData(int client_fd, const std::string& data) { handleTCPData(client_fd, data); }
+    void onUdpMessage(UDPServer& server, const std::string& data, const PeerAddress& addr) {
+        handleUDPData(server, data, addr);
+    }
 private:
+    // Longest request line; a client that sends more without '\n' is disconnected
+    static constexpr size_t MAX_TCP_LINE_BYTES = 1024 * 1024;
+
     std::unique_ptr<EPollManager> m_epollManager;
     std::unique_ptr<UDPServer> m_udpServer;
+    std::unique_ptr<UDPServer> m_unixUdpServer;
     std::unique_ptr<TCPServer> m_tcpServer;
     std::unique_ptr<ServerStats> m_serverStats;
     std::unique_ptr<CommandProcessor> m_commandProcessor;
+    std::unique_ptr<SessionManager> m_sessionManager;
+    std::unique_ptr<PubSub> m_pubSub;
+    std::unique_ptr<KeyValueStore> m_keyValueStore;
+    std::unique_ptr<StatsPublisher> m_statsPublisher;
+    std::unique_ptr<TrafficCapture> m_capture;
+    std::unique_ptr<FileCache> m_fileCache;
+    std::unique_ptr<UpstreamPool> m_upstreams;
+    LoopbackTransport* m_loopback = nullptr;   // owned through m_epollManager
     std::string m_serverIP;
     int m_serverPort;
-    bool m_running = false;
+    int m_adminPort = 0;
+    std::string m_unixSocketPath;
+    std::string m_statsSegmentName;
+    std::string m_capturePath;
+    BusyPollConfig m_busyPoll;
+    std::atomic<bool> m_running{false};
+    TaskQueue m_tasks;
+    std::thread m_traceDumper;
+    std::atomic<bool> m_traceDumping{false};
+
+    // Start of the command being handled, for slow callback reports
+    std::array<char, 64> m_currentCommand{};
+    size_t m_currentCommandLength = 0;
 
     void setupCallbacks();
     void setupCommandProcessor();
+    bool startListeners();
+    std::string formatTopClients(size_t count, bool byBytes) const;
+
+    void applyBusyPoll();
+    // Writes DEFAULT_DUMP_PATH on a helper thread, the rings are safe to snapshot from there
+    void startTraceDump();
+    LoopClock::time_point finishHandler(LoopHandler handler, int fd, LoopClock::time_point started);
+    void trackCommand(const std::string &command);
 
-    void handleTCPConnect(int client_fd, const sockaddr_in &addr);
+    void handleTCPConnect(int client_fd, const PeerAddress &addr);
     void handleTCPData(int client_fd, const std::string &data);
+    // false when the connection should not be read further (shutdown)
+    bool handleTCPFrame(int client_fd, std::string_view frame);
     void handleTCPDisconnect(int client_fd);
-    void handleUDPData(const std::string data, const sockaddr_in& addr);
-    std::string trimNetworkData(const std::string& data);
+    bool handleClientCommand(int client_fd, const std::string &command);
+    void handleUDPData(UDPServer& server, const std::string& data, const PeerAddress& addr);
     void gracefulShutdown();
 };
 
+template<UdpMessageHandler Handler>
+void UDPServer::handleMessage(Handler& handler) {
+    constexpr size_t BUFFER_SIZE = 1024;
+    char buffer[BUFFER_SIZE];
+
+    while (true) {
+        PeerAddress clientAddr;
+        TraceRequest trace;
+        ssize_t bytesReceived = m_transport->recvfrom(m_server_fd, buffer, BUFFER_SIZE - 1, clientAddr);
+        if (bytesReceived > 0) {
+            trace.received(TraceStage::UdpRecv, m_server_fd);
+            buffer[bytesReceived] = '\0';
+            std::string message(buffer);
+
+            handler.onUdpMessage(*this, message, clientAddr);
+        } else {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            } else {
+                std::cerr << "UDP recvfrom error: " << strerror(errno) << std::endl;
+                break;
+            }
+        }
+    }
+}
+
+template<TcpDataHandler Handler>
+void TCPServer::handleClientData(int client_fd, Handler& handler) {
+    constexpr size_t BUFFER_SIZE = 1024;
+    char buffer[BUFFER_SIZE];
+    auto it = m_clients.find(client_fd);
+    if (it == m_clients.end() || it->second.readQueued) {
+        // A queued client is read by resumeReads, this edge adds nothing to it
+        return;
+    }
+    const bool admin = it->second.admin;
+    size_t bytes_total = 0;
+    size_t reads = 0;
+    while (true) {
+        if (!admin && ((m_readBudget.bytes && bytes_total >= m_readBudget.bytes)
+                       || (m_readBudget.reads && reads >= m_readBudget.reads))) {
+            queueRead(client_fd);
+            break;
+        }
+        TraceRequest trace;
+        ssize_t bytes_read = m_transport->recv(client_fd, buffer, BUFFER_SIZE - 1);
+        if (bytes_read > 0) {
+            trace.received(TraceStage::TcpRecv, client_fd);
+            // Whole read, a NUL byte must not cut off the '\n' that ends the line
+            std::string message(buffer, static_cast<size_t>(bytes_read));
+
+            auto started = LoopClock::now();
+            handler.onTcpData(client_fd, message);
+            if (!recordRequest(client_fd, static_cast<size_t>(bytes_read), started)) {
+                break;
+            }
+            bytes_total += static_cast<size_t>(bytes_read);
+            ++reads;
+        } else if (bytes_read == 0) {
+            disconnectClient(client_fd);
+            break;
+        } else {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            } else {
+                disconnectClient(client_fd);
+                break;
+            }
+        }
+
+    }
+}
+template<TcpDataHandler Handler>
+void TCPServer::resumeReads(Handler& handler) {
+    // Clients that run out of budget again are queued for the next pass, not this one
+    m_resuming.swap(m_readyClients);
+    for (int client_fd : m_resuming) {
+        auto it = m_clients.find(client_fd);
+        if (it == m_clients.end() || !it->second.readQueued) {
+            continue;
+        }
+        it->second.readQueued = false;
+        handleClientData(client_fd, handler);
+    }
+    m_resuming.clear();
+}
+
 #endif //ASYNCSERVER_ASYNCSERVER_H
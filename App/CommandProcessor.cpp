@@ -3,7 +3,11 @@
 //
 
 #include "CommandProcessor.h"
+#include "KeyValueStore.h"
+#include "Tracer.h"
 
+#include <algorithm>
+#include <charconv>
 #include <iomanip>
 #include <iostream>
 #include <termios.h>
@@ -11,10 +15,25 @@ CommandProcessor::~CommandProcessor() {
     stopConsoleHandler();
 }
 std::string CommandProcessor::processCommand(std::string &command, ServerStats &stats) {
+    size_t name_end = command.find(' ');
+    std::string name = command.substr(0, name_end);
+    if (name == "/set" || name == "/get" || name == "/del" || name == "/incr" || name == "/expire") {
+        std::string args = name_end == std::string::npos ? "" : command.substr(name_end + 1);
+        return processKeyValueCommand(name, args, stats);
+    }
+    if (name == "/clients") {
+        return processClientsCommand(name_end == std::string::npos ? "" : command.substr(name_end + 1));
+    }
+    if (name == "/trace-dump" || name == "/trace-sample") {
+        return processTraceCommand(name, name_end == std::string::npos ? "" : command.substr(name_end + 1), false);
+    }
+
     if (command == "/time") {
         return getCurrentDateTime();
     } else if (command == "/stats") {
         return formatStats(stats);
+    } else if (command == "/upstreams") {
+        return m_upstreamsCallback ? m_upstreamsCallback() : "Upstreams are disabled";
     } else if (command == "/shutdown") {
         return "SHUTDOWN";
     } else if (!command.empty() && command[0] == '/') {
@@ -23,6 +42,11 @@ std::string CommandProcessor::processCommand(std::string &command, ServerStats &
         return command;
     }
 }
+bool CommandProcessor::isControlCommand(std::string_view command) {
+    std::string_view name = command.substr(0, command.find(' '));
+    return name == "/stats" || name == "/shutdown" || name == "/clients" || name == "/upstreams"
+        || name == "/trace-dump" || name == "/trace-sample";
+}
 bool CommandProcessor::startConsoleHandler() {
     if (m_consoleRunning.exchange(true)) {
         std::cout << "Console handler is already running" << std::endl;
@@ -68,13 +92,146 @@ std::string CommandProcessor::getCurrentDateTime() {
     return oss.str();
 }
 std::string CommandProcessor::formatStats(const ServerStats &stats) {
+    KeyValueStats kv = stats.getKeyValueStats();
+    uint64_t lookups = kv.hits + kv.misses;
+    double hitRate = lookups ? 100.0 * kv.hits / lookups : 0.0;
+
     std::ostringstream oss;
     oss << "Server statistics:\n"
     << "\tCurrent connected clients: " << stats.getCurrentClients() << "\n"
-    << "\tTotal clients connected: " << stats.getTotalClients();
+    << "\tTotal clients connected: " << stats.getTotalClients() << "\n"
+    << "\tKV keys: " << kv.keys << "\n"
+    << "\tKV memory: " << kv.memoryUsed << " / " << kv.memoryLimit << " bytes\n"
+    << "\tKV hits/misses: " << kv.hits << "/" << kv.misses
+    << " (" << std::fixed << std::setprecision(1) << hitRate << "% hit rate)\n"
+    << "\tKV evicted/expired: " << kv.evictions << "/" << kv.expired << "\n"
+    << "\tUDP send queue: " << stats.getUdpQueueDepth() << " queued, "
+    << stats.getUdpDeferred() << " deferred, " << stats.getUdpDropped() << " dropped\n";
+    formatLoopStats(oss, stats.getLoopStats());
 
     return oss.str();
 }
+void CommandProcessor::formatLoopStats(std::ostringstream &oss, const LoopStats &loop) {
+    uint64_t busy = loop.getBusyNs();
+    uint64_t idle = loop.getIdleNs();
+    uint64_t wakeups = loop.getWakeups();
+    uint64_t iterations = loop.getIterations();
+
+    oss << std::fixed << std::setprecision(1)
+    << "\tEvent loop: " << iterations << " iterations, busy "
+    << (busy + idle ? 100.0 * busy / (busy + idle) : 0.0) << "% ("
+    << busy / 1000000 << " ms busy / " << idle / 1000000 << " ms waiting)\n"
+    << "\tEvents per wakeup: avg " << (wakeups ? double(loop.getEvents()) / wakeups : 0.0)
+    << ", max " << loop.getMaxEventsPerWakeup() << "\n"
+    << "\tLoop lag: last " << loop.getLastLagNs() / 1000 << " us, avg "
+    << (iterations ? busy / iterations / 1000 : 0) << " us, max " << loop.getMaxLagNs() / 1000 << " us\n"
+    << "\tHandlers (calls / avg us / max us):";
+    for (size_t i = 0; i < LoopStats::HANDLER_COUNT; ++i) {
+        auto handler = static_cast<LoopHandler>(i);
+        LoopStats::HandlerTotals totals = loop.getHandler(handler);
+        oss << "\n\t\t" << loopHandlerName(handler) << ": " << totals.calls << " / "
+        << (totals.calls ? double(totals.totalNs) / totals.calls / 1000 : 0.0) << " / "
+        << totals.maxNs / 1000;
+    }
+    oss << "\n\tSlow callbacks (>= " << loop.getSlowThresholdNs() / 1000 << " us): " << loop.getSlowCallbacks();
+    oss << "\n\tRead budget yields: " << loop.getReadYields();
+    oss << "\n\tPriority lane events: " << loop.getPriorityEvents();
+    if (loop.isBusyPollEnabled()) {
+        uint64_t spins = loop.getSpinHits() + loop.getSpinMisses();
+        oss << "\n\tBusy poll: " << spins << " spins (" << loop.getSpinHits() << " with events, "
+        << (spins ? 100.0 * loop.getSpinMisses() / spins : 0.0) << "% idle), "
+        << loop.getBlockingWaits() << " blocking waits";
+    }
+}
+std::string CommandProcessor::processKeyValueCommand(const std::string &name, const std::string &args,
+                                                     ServerStats &stats) {
+    if (!m_keyValueStore) {
+        return "Key-value store is disabled";
+    }
+
+    size_t key_end = args.find(' ');
+    std::string key = args.substr(0, key_end);
+    std::string rest = key_end == std::string::npos ? "" : args.substr(key_end + 1);
+    if (key.empty()) {
+        return "Usage: " + name + " <key>" + (name == "/set" ? " <value>" : name == "/expire" ? " <seconds>" : "");
+    }
+
+    std::string response;
+    if (name == "/set") {
+        response = m_keyValueStore->set(key, rest) ? "OK" : "ERR memory limit reached";
+    } else if (name == "/get") {
+        auto value = m_keyValueStore->get(key);
+        response = value ? std::string(*value) : "(nil)";
+    } else if (name == "/del") {
+        response = m_keyValueStore->del(key) ? "1" : "0";
+    } else if (name == "/incr") {
+        auto value = m_keyValueStore->incr(key);
+        response = value ? std::to_string(*value) : "ERR value is not an integer or out of range";
+    } else {
+        long long seconds = 0;
+        auto [end, ec] = std::from_chars(rest.data(), rest.data() + rest.size(), seconds);
+        if (rest.empty() || ec != std::errc() || end != rest.data() + rest.size()) {
+            return "Usage: /expire <key> <seconds>";
+        }
+        if (seconds > KeyValueStore::MAX_TTL.count()) {
+            return "ERR expire time is out of range (max " + std::to_string(KeyValueStore::MAX_TTL.count()) + " seconds)";
+        }
+        // Any non-positive TTL deletes the key, clamp before the conversion to milliseconds
+        seconds = std::max(seconds, 0LL);
+        response = m_keyValueStore->expire(key, std::chrono::seconds(seconds)) ? "1" : "0";
+    }
+
+    stats.setKeyValueStats(m_keyValueStore->getStats());
+    return response;
+}
+std::string CommandProcessor::processClientsCommand(const std::string &args) {
+    // /clients [N] [rate|bytes]
+    constexpr size_t DEFAULT_TOP = 10;
+    size_t count = DEFAULT_TOP;
+    bool byBytes = false;
+    std::istringstream iss(args);
+    std::string token;
+    while (iss >> token) {
+        size_t value = 0;
+        auto [end, ec] = std::from_chars(token.data(), token.data() + token.size(), value);
+        if (ec == std::errc() && end == token.data() + token.size()) {
+            count = value;
+        } else if (token == "rate" || token == "bytes") {
+            byBytes = token == "bytes";
+        } else {
+            return "Usage: /clients [N] [rate|bytes]";
+        }
+    }
+    if (!m_clientsCallback) {
+        return "Clients callback not set";
+    }
+    return m_clientsCallback(count, byBytes);
+}
+std::string CommandProcessor::processTraceCommand(const std::string &name, const std::string &args, bool fromConsole) {
+    if (name == "/trace-sample") {
+        uint32_t every = 0;
+        auto [end, ec] = std::from_chars(args.data(), args.data() + args.size(), every);
+        if (args.empty() || ec != std::errc() || end != args.data() + args.size()) {
+            return "Usage: /trace-sample <N> (trace 1 of N reads, 0 - off)";
+        }
+        Tracer::setSampleEvery(every);
+        return every ? "Tracing 1 of " + args + " reads" : "Tracing disabled";
+    }
+
+    if (!fromConsole) {
+        if (!args.empty()) {
+            return std::string("Usage: /trace-dump (writes ") + Tracer::DEFAULT_DUMP_PATH + ", other paths from the console only)";
+        }
+        Tracer::requestDump();
+        return std::string("Trace dump requested, writing ") + Tracer::DEFAULT_DUMP_PATH;
+    }
+    std::string path = args.empty() ? Tracer::DEFAULT_DUMP_PATH : args;
+    size_t traced = 0;
+    if (!Tracer::dumpChromeTrace(path, traced)) {
+        return "ERR cannot write " + path;
+    }
+    return "Trace written to " + path + " (" + std::to_string(traced) + " spans)";
+}
 void CommandProcessor::consoleInputHandler() {
 
     std::cout << "> ";
@@ -103,6 +260,8 @@ void CommandProcessor::processConsoleInput(const std::string &input) {
           << "  /shutdown - Stop the server\n"
           << "  /stats          - Show server statistics\n"
           << "  /time           - Show current time\n"
+          << "  /trace-sample N - Trace 1 of N requests (0 - off)\n"
+          << "  /trace-dump [path] - Write sampled spans as a Chrome trace (clients: default path only)\n"
           << std::endl;
     } else if (input == "/status") {
         if (m_statsCallback) {
@@ -125,6 +284,10 @@ void CommandProcessor::processConsoleInput(const std::string &input) {
         }
     } else if (input == "/time") {
         std::cout << getCurrentDateTime() << std::endl;
+    } else if (input.starts_with("/trace-")) {
+        size_t name_end = input.find(' ');
+        std::cout << processTraceCommand(input.substr(0, name_end),
+                                         name_end == std::string::npos ? "" : input.substr(name_end + 1), true) << std::endl;
     } else if (input[0] == '/') {
         std::cout << "Unknown console command: " << input
                   << "\nType 'help' for available commands." << std::endl;
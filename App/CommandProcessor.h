@@ -5,20 +5,27 @@
 #ifndef ASYNCSERVER_PARSERCLI_H
 #define ASYNCSERVER_PARSERCLI_H
 #include <functional>
+#include <sstream>
 #include <string>
+#include <string_view>
 #include <thread>
 
 #include "ServerStats.h"
 
+class KeyValueStore;
+
 class CommandProcessor {
 public:
     using ShutdownCallback = std::function<void()>;
     using StatsCallback = std::function<std::string()>;
+    using ClientsCallback = std::function<std::string(size_t count, bool byBytes)>;
 
     CommandProcessor() = default;
     ~CommandProcessor();
 
     std::string processCommand(std::string& command, ServerStats& stats);
+    // Operator commands: never forwarded to upstreams, skipped by the replay tool
+    static bool isControlCommand(std::string_view command);
 
     // handlers
     bool startConsoleHandler();
@@ -28,17 +35,30 @@ public:
     // reg callbacks
     void setShutdownCallback(ShutdownCallback cb) { m_shutdownCallback = std::move(cb); }
     void setStatsCallbacks(StatsCallback cb) { m_statsCallback = std::move(cb); }
+    void setClientsCallback(ClientsCallback cb) { m_clientsCallback = std::move(cb); }
+    void setUpstreamsCallback(StatsCallback cb) { m_upstreamsCallback = std::move(cb); }
+    // Store owned by the reactor that calls processCommand
+    void setKeyValueStore(KeyValueStore* store) { m_keyValueStore = store; }
 
     static std::string getCurrentDateTime();
     static std::string formatStats(const ServerStats& stats);
+    static void formatLoopStats(std::ostringstream& oss, const LoopStats& loop);
 
 private:
     void consoleInputHandler();
     void processConsoleInput(const std::string& input);
+    std::string processKeyValueCommand(const std::string& name, const std::string& args, ServerStats& stats);
+    std::string processClientsCommand(const std::string& args);
+    // A dump path is taken only from the console; clients get the fixed file, written off the reactor
+    static std::string processTraceCommand(const std::string& name, const std::string& args, bool fromConsole);
 
     // Callbacks
     ShutdownCallback m_shutdownCallback;
     StatsCallback m_statsCallback;
+    ClientsCallback m_clientsCallback;
+    StatsCallback m_upstreamsCallback;
+
+    KeyValueStore* m_keyValueStore = nullptr;
 
     //sync
     std::atomic<bool> m_consoleRunning{false} ;
@@ -0,0 +1,101 @@
+//
+// Created by roach on 19.11.2025.
+//
+
+#include "FileCache.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+CachedFile::~CachedFile() {
+    if (fd != -1) {
+        ::close(fd);
+    }
+}
+
+FileCache::~FileCache() {
+    m_entries.clear();
+    if (m_dir_fd != -1) {
+        ::close(m_dir_fd);
+    }
+}
+bool FileCache::setRoot(const std::string &directory) {
+    int dir_fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd == -1) {
+        std::cerr << "Cannot open file directory " << directory << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    m_entries.clear();
+    if (m_dir_fd != -1) {
+        ::close(m_dir_fd);
+    }
+    m_dir_fd = dir_fd;
+    std::cout << "Serving files from " << directory << std::endl;
+    return true;
+}
+FileCache::FilePtr FileCache::open(const std::string &name, std::string &error) {
+    if (!isEnabled()) {
+        error = "file serving is disabled";
+        return nullptr;
+    }
+    if (!validName(name)) {
+        error = "invalid file name";
+        return nullptr;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    auto it = m_entries.find(name);
+    if (it != m_entries.end()) {
+        if (now - it->second.checked < REVALIDATE_INTERVAL) {
+            return it->second.file;
+        }
+        // Reuse the open fd while the file on disk is still the same
+        struct stat info{};
+        const CachedFile& cached = *it->second.file;
+        if (::fstatat(m_dir_fd, name.c_str(), &info, AT_SYMLINK_NOFOLLOW) == 0
+            && info.st_ino == cached.inode && static_cast<size_t>(info.st_size) == cached.size
+            && info.st_mtim.tv_sec == cached.modified.tv_sec && info.st_mtim.tv_nsec == cached.modified.tv_nsec) {
+            it->second.checked = now;
+            return it->second.file;
+        }
+        m_entries.erase(it);
+    }
+
+    FilePtr file = openFile(name, error);
+    if (!file) {
+        return nullptr;
+    }
+    if (m_entries.size() >= MAX_ENTRIES) {
+        // Bounded number of cached fds; running transfers keep theirs
+        m_entries.erase(m_entries.begin());
+    }
+    m_entries[name] = Entry{file, now};
+    return file;
+}
+bool FileCache::validName(const std::string &name) {
+    return !name.empty() && name != "." && name != ".."
+           && name.find('/') == std::string::npos && name.find('\0') == std::string::npos;
+}
+FileCache::FilePtr FileCache::openFile(const std::string &name, std::string &error) const {
+    int fd = ::openat(m_dir_fd, name.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC | O_NONBLOCK);
+    if (fd == -1) {
+        error = errno == ENOENT ? "no such file" : strerror(errno);
+        return nullptr;
+    }
+    auto file = std::make_shared<CachedFile>();
+    file->fd = fd;
+
+    struct stat info{};
+    if (::fstat(fd, &info) == -1 || !S_ISREG(info.st_mode)) {
+        error = "not a regular file";
+        return nullptr;
+    }
+    file->size = static_cast<size_t>(info.st_size);
+    file->inode = info.st_ino;
+    file->modified = info.st_mtim;
+    return file;
+}
@@ -0,0 +1,63 @@
+//
+// Created by roach on 19.11.2025.
+//
+
+#ifndef ASYNCSERVER_FILECACHE_H
+#define ASYNCSERVER_FILECACHE_H
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+
+// Open file served by /get-file. Transfers hold a reference, so the fd stays valid
+// even when the cache drops or replaces the entry mid-transfer.
+struct CachedFile {
+    int fd = -1;
+    size_t size = 0;
+    ino_t inode = 0;
+    timespec modified{};
+
+    CachedFile() = default;
+    CachedFile(const CachedFile&) = delete;
+    CachedFile& operator=(const CachedFile&) = delete;
+    ~CachedFile();
+};
+
+// Open fds and metadata of files in one directory. Only plain names are accepted,
+// so a request can never leave the directory.
+class FileCache {
+public:
+    using FilePtr = std::shared_ptr<const CachedFile>;
+
+    FileCache() = default;
+    FileCache(const FileCache&) = delete;
+    FileCache& operator=(const FileCache&) = delete;
+    ~FileCache();
+
+    bool setRoot(const std::string& directory);
+    bool isEnabled() const { return m_dir_fd != -1; }
+
+    // nullptr and a reason in error when the file cannot be served
+    FilePtr open(const std::string& name, std::string& error);
+
+private:
+    static constexpr size_t MAX_ENTRIES = 256;
+    // Cached metadata is trusted for this long before the file is checked again
+    static constexpr auto REVALIDATE_INTERVAL = std::chrono::seconds(1);
+
+    struct Entry {
+        FilePtr file;
+        std::chrono::steady_clock::time_point checked;
+    };
+
+    static bool validName(const std::string& name);
+    FilePtr openFile(const std::string& name, std::string& error) const;
+
+    int m_dir_fd = -1;
+    std::unordered_map<std::string, Entry> m_entries;
+};
+
+
+#endif //ASYNCSERVER_FILECACHE_H
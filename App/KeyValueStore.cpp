@@ -0,0 +1,412 @@
+//
+// Created by roach on 19.11.2025.
+//
+
+#include "KeyValueStore.h"
+
+#include <bit>
+#include <charconv>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <new>
+
+KeyValueArena::~KeyValueArena() {
+    for (auto& [base, chunk] : m_chunks) {
+        ::operator delete(chunk->memory, std::align_val_t{CHUNK_SIZE});
+    }
+}
+
+size_t KeyValueArena::classIndex(size_t size) {
+    if (size <= (size_t{1} << MIN_BLOCK_SHIFT)) {
+        return 0;
+    }
+    return std::bit_width(size - 1) - MIN_BLOCK_SHIFT;
+}
+size_t KeyValueArena::blockSize(size_t size) {
+    if (size > (size_t{1} << MAX_BLOCK_SHIFT)) {
+        return size;
+    }
+    return size_t{1} << (classIndex(size) + MIN_BLOCK_SHIFT);
+}
+size_t KeyValueArena::minReservation(size_t size) {
+    return size > (size_t{1} << MAX_BLOCK_SHIFT) ? size : CHUNK_SIZE;
+}
+size_t KeyValueArena::reservationCost(size_t size) const {
+    if (size > (size_t{1} << MAX_BLOCK_SHIFT)) {
+        return size;
+    }
+    return m_withRoom[classIndex(size)] ? 0 : CHUNK_SIZE;
+}
+char* KeyValueArena::allocate(size_t size) {
+    const size_t bytes = blockSize(size);
+    if (bytes > (size_t{1} << MAX_BLOCK_SHIFT)) {
+        m_liveBytes += bytes;
+        m_reservedBytes += bytes;
+        return new char[bytes];
+    }
+
+    const size_t index = classIndex(size);
+    Chunk* chunk = m_withRoom[index];
+    if (!chunk) {
+        auto owned = std::make_unique<Chunk>();
+        owned->memory = static_cast<char*>(::operator new(CHUNK_SIZE, std::align_val_t{CHUNK_SIZE}));
+        owned->classIndex = index;
+        chunk = owned.get();
+        m_chunks.emplace(reinterpret_cast<uintptr_t>(chunk->memory), std::move(owned));
+        m_reservedBytes += CHUNK_SIZE;
+        link(*chunk);
+    }
+
+    char* block;
+    if (FreeBlock* head = chunk->freeList) {
+        chunk->freeList = head->next;
+        block = reinterpret_cast<char*>(head);
+    } else {
+        block = chunk->memory + chunk->carved;
+        chunk->carved += bytes;
+    }
+    ++chunk->liveBlocks;
+    m_liveBytes += bytes;
+    if (!hasRoom(*chunk)) {
+        unlink(*chunk);
+    }
+    return block;
+}
+void KeyValueArena::release(char* block, size_t size) {
+    const size_t bytes = blockSize(size);
+    m_liveBytes -= bytes;
+    if (bytes > (size_t{1} << MAX_BLOCK_SHIFT)) {
+        m_reservedBytes -= bytes;
+        delete[] block;
+        return;
+    }
+    const uintptr_t base = reinterpret_cast<uintptr_t>(block) & ~(CHUNK_SIZE - 1);
+    Chunk& chunk = *m_chunks.at(base);
+    auto* freeBlock = reinterpret_cast<FreeBlock*>(block);
+    freeBlock->next = chunk.freeList;
+    chunk.freeList = freeBlock;
+    if (--chunk.liveBlocks == 0) {
+        freeChunk(chunk);
+    } else if (!chunk.listed) {
+        link(chunk);
+    }
+}
+bool KeyValueArena::hasRoom(const Chunk& chunk) {
+    return chunk.freeList || chunk.carved + blockSize(size_t{1} << (chunk.classIndex + MIN_BLOCK_SHIFT)) <= CHUNK_SIZE;
+}
+void KeyValueArena::link(Chunk& chunk) {
+    Chunk*& head = m_withRoom[chunk.classIndex];
+    chunk.prev = nullptr;
+    chunk.next = head;
+    if (head) {
+        head->prev = &chunk;
+    }
+    head = &chunk;
+    chunk.listed = true;
+}
+void KeyValueArena::unlink(Chunk& chunk) {
+    if (chunk.prev) {
+        chunk.prev->next = chunk.next;
+    } else {
+        m_withRoom[chunk.classIndex] = chunk.next;
+    }
+    if (chunk.next) {
+        chunk.next->prev = chunk.prev;
+    }
+    chunk.prev = chunk.next = nullptr;
+    chunk.listed = false;
+}
+void KeyValueArena::freeChunk(Chunk& chunk) {
+    if (chunk.listed) {
+        unlink(chunk);
+    }
+    m_reservedBytes -= CHUNK_SIZE;
+    ::operator delete(chunk.memory, std::align_val_t{CHUNK_SIZE});
+    m_chunks.erase(reinterpret_cast<uintptr_t>(chunk.memory));
+}
+
+KeyValueStore::KeyValueStore(size_t maxMemoryBytes) :
+    m_slots(INITIAL_CAPACITY),
+    m_maxMemory(maxMemoryBytes) {
+}
+KeyValueStore::~KeyValueStore() {
+    // Large blocks are owned by the heap, not by arena chunks
+    for (auto& slot : m_slots) {
+        if (slot.block) {
+            m_arena.release(slot.block, slot.keyLength + slot.valueLength);
+        }
+    }
+}
+bool KeyValueStore::set(std::string_view key, std::string_view value) {
+    return writeValue(key, value, false);
+}
+std::optional<std::string_view> KeyValueStore::get(std::string_view key) {
+    Slot* slot = findLive(key);
+    if (!slot) {
+        ++m_misses;
+        return std::nullopt;
+    }
+    ++m_hits;
+    return slot->value();
+}
+bool KeyValueStore::del(std::string_view key) {
+    bool found = false;
+    size_t index = findSlot(key, hashKey(key), found);
+    if (!found) {
+        return false;
+    }
+    bool expired = m_slots[index].expireAt != 0 && m_slots[index].expireAt <= nowMs();
+    eraseAt(index);
+    if (expired) {
+        ++m_expired;
+        return false;
+    }
+    return true;
+}
+std::optional<int64_t> KeyValueStore::incr(std::string_view key) {
+    int64_t value = 0;
+    if (Slot* slot = findLive(key)) {
+        std::string_view current = slot->value();
+        auto [end, ec] = std::from_chars(current.data(), current.data() + current.size(), value);
+        if (ec != std::errc() || end != current.data() + current.size()) {
+            return std::nullopt;
+        }
+    }
+    if (value == std::numeric_limits<int64_t>::max()) {
+        return std::nullopt;
+    }
+    ++value;
+
+    char buffer[24];
+    auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    if (!writeValue(key, std::string_view(buffer, end - buffer), true)) {
+        return std::nullopt;
+    }
+    return value;
+}
+bool KeyValueStore::expire(std::string_view key, std::chrono::milliseconds ttl) {
+    if (ttl > MAX_TTL) {
+        return false;
+    }
+    Slot* slot = findLive(key);
+    if (!slot) {
+        return false;
+    }
+    if (ttl.count() <= 0) {
+        return del(key);
+    }
+    if (slot->expireAt == 0) {
+        ++m_volatileCount;
+    }
+    slot->expireAt = nowMs() + ttl.count();
+    return true;
+}
+size_t KeyValueStore::expireCycle(size_t maxSlots) {
+    if (m_volatileCount == 0) {
+        return 0;
+    }
+    const int64_t now = nowMs();
+    size_t removed = 0;
+    for (size_t scanned = 0; scanned < maxSlots && m_volatileCount > 0; ++scanned) {
+        size_t index = m_expireCursor & mask();
+        const Slot& slot = m_slots[index];
+        if (slot.block && slot.expireAt != 0 && slot.expireAt <= now) {
+            // Backward shift may move another key into this slot, so check it again
+            eraseAt(index);
+            ++m_expired;
+            ++removed;
+        } else {
+            ++m_expireCursor;
+        }
+    }
+    return removed;
+}
+void KeyValueStore::setMaxMemory(size_t maxMemoryBytes) {
+    m_maxMemory = maxMemoryBytes;
+    while (m_count > 0 && getMemoryUsed() > m_maxMemory) {
+        evictOne();
+    }
+}
+size_t KeyValueStore::getMemoryUsed() const {
+    // Reserved, not live bytes: freed blocks of a partly used chunk are still resident
+    return m_arena.getReservedBytes() + m_slots.size() * sizeof(Slot);
+}
+KeyValueStats KeyValueStore::getStats() const {
+    KeyValueStats stats;
+    stats.keys = m_count;
+    stats.memoryUsed = getMemoryUsed();
+    stats.memoryLimit = m_maxMemory;
+    stats.hits = m_hits;
+    stats.misses = m_misses;
+    stats.evictions = m_evictions;
+    stats.expired = m_expired;
+    return stats;
+}
+uint32_t KeyValueStore::hashKey(std::string_view key) {
+    size_t hash = std::hash<std::string_view>{}(key);
+    return static_cast<uint32_t>(hash ^ (hash >> 32));
+}
+int64_t KeyValueStore::nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now().time_since_epoch()).count();
+}
+size_t KeyValueStore::findSlot(std::string_view key, uint32_t hash, bool &found) const {
+    size_t index = hash & mask();
+    while (true) {
+        const Slot& slot = m_slots[index];
+        if (!slot.block) {
+            found = false;
+            return index;
+        }
+        if (slot.hash == hash && slot.key() == key) {
+            found = true;
+            return index;
+        }
+        index = (index + 1) & mask();
+    }
+}
+KeyValueStore::Slot* KeyValueStore::findLive(std::string_view key) {
+    bool found = false;
+    size_t index = findSlot(key, hashKey(key), found);
+    if (!found) {
+        return nullptr;
+    }
+    Slot& slot = m_slots[index];
+    if (slot.expireAt != 0 && slot.expireAt <= nowMs()) {
+        // Lazy expiry on access
+        eraseAt(index);
+        ++m_expired;
+        return nullptr;
+    }
+    slot.lastAccess = ++m_lruClock;
+    return &slot;
+}
+bool KeyValueStore::writeValue(std::string_view key, std::string_view value, bool keepTtl) {
+    if (key.empty() || key.size() > std::numeric_limits<uint32_t>::max()
+        || value.size() > std::numeric_limits<uint32_t>::max()) {
+        return false;
+    }
+
+    const uint32_t hash = hashKey(key);
+    const size_t length = key.size() + value.size();
+    // makeRoom can fail only when the block does not fit even into an empty store, whose table
+    // does not grow. Check that before the old entry is touched, a failed write must leave the key as it was.
+    if (m_slots.size() * sizeof(Slot) + KeyValueArena::minReservation(length) > m_maxMemory) {
+        return false;
+    }
+    bool found = false;
+    size_t index = findSlot(key, hash, found);
+    int64_t expireAt = 0;
+
+    if (found) {
+        Slot& slot = m_slots[index];
+        if (keepTtl) {
+            expireAt = slot.expireAt;
+        }
+        if (KeyValueArena::blockSize(slot.keyLength + slot.valueLength) == KeyValueArena::blockSize(length)) {
+            // Same size class: overwrite the value in place
+            std::memcpy(slot.block + slot.keyLength, value.data(), value.size());
+            slot.valueLength = static_cast<uint32_t>(value.size());
+            slot.lastAccess = ++m_lruClock;
+            if (slot.expireAt != 0 && expireAt == 0) {
+                --m_volatileCount;
+            }
+            slot.expireAt = expireAt;
+            return true;
+        }
+        eraseAt(index);
+    }
+
+    if (!makeRoom(length)) {
+        return false;
+    }
+    if (growthBytes() > 0) {
+        grow();
+    }
+    // Eviction and growth move slots around
+    index = findSlot(key, hash, found);
+
+    Slot& slot = m_slots[index];
+    slot.block = m_arena.allocate(length);
+    std::memcpy(slot.block, key.data(), key.size());
+    std::memcpy(slot.block + key.size(), value.data(), value.size());
+    slot.hash = hash;
+    slot.keyLength = static_cast<uint32_t>(key.size());
+    slot.valueLength = static_cast<uint32_t>(value.size());
+    slot.lastAccess = ++m_lruClock;
+    slot.expireAt = expireAt;
+    ++m_count;
+    if (expireAt != 0) {
+        ++m_volatileCount;
+    }
+    return true;
+}
+void KeyValueStore::eraseAt(size_t index) {
+    Slot& slot = m_slots[index];
+    m_arena.release(slot.block, slot.keyLength + slot.valueLength);
+    if (slot.expireAt != 0) {
+        --m_volatileCount;
+    }
+    --m_count;
+
+    // Backward shift deletion keeps probe chains intact without tombstones
+    size_t hole = index;
+    size_t next = index;
+    while (true) {
+        next = (next + 1) & mask();
+        if (!m_slots[next].block) {
+            break;
+        }
+        size_t ideal = m_slots[next].hash & mask();
+        if (((next - ideal) & mask()) >= ((next - hole) & mask())) {
+            m_slots[hole] = m_slots[next];
+            hole = next;
+        }
+    }
+    m_slots[hole] = Slot{};
+}
+size_t KeyValueStore::growthBytes() const {
+    return (m_count + 1) * 10 > m_slots.size() * 7 ? m_slots.size() * sizeof(Slot) : 0;
+}
+void KeyValueStore::grow() {
+    std::vector<Slot> old(m_slots.size() * 2);
+    old.swap(m_slots);
+    for (const auto& slot : old) {
+        if (!slot.block) {
+            continue;
+        }
+        size_t index = slot.hash & mask();
+        while (m_slots[index].block) {
+            index = (index + 1) & mask();
+        }
+        m_slots[index] = slot;
+    }
+}
+bool KeyValueStore::makeRoom(size_t length) {
+    // Both terms shrink as keys go: evictions free chunks and blocks, and fewer keys need no growth
+    while (getMemoryUsed() + growthBytes() + m_arena.reservationCost(length) > m_maxMemory) {
+        if (m_count == 0) {
+            return false;
+        }
+        evictOne();
+    }
+    return true;
+}
+void KeyValueStore::evictOne() {
+    // Approximate LRU: the oldest of a few random keys
+    size_t victim = m_slots.size();
+    uint32_t oldestAge = 0;
+    for (size_t sample = 0; sample < EVICTION_SAMPLES; ++sample) {
+        size_t index = m_random() & mask();
+        while (!m_slots[index].block) {
+            index = (index + 1) & mask();
+        }
+        uint32_t age = m_lruClock - m_slots[index].lastAccess;
+        if (victim == m_slots.size() || age > oldestAge) {
+            victim = index;
+            oldestAge = age;
+        }
+    }
+    eraseAt(victim);
+    ++m_evictions;
+}
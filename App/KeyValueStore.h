@@ -0,0 +1,161 @@
+//
+// Created by roach on 19.11.2025.
+//
+
+#ifndef ASYNCSERVER_KEYVALUESTORE_H
+#define ASYNCSERVER_KEYVALUESTORE_H
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "ServerStats.h"
+
+// Size-class allocator for key/value blocks. Each chunk serves one size class and keeps its own
+// free list; a chunk whose blocks are all free goes back to the heap, so the reservation follows
+// the live data after churn across value sizes. Big values go to the heap directly.
+class KeyValueArena {
+public:
+    KeyValueArena() = default;
+    KeyValueArena(const KeyValueArena&) = delete;
+    KeyValueArena& operator=(const KeyValueArena&) = delete;
+    ~KeyValueArena();
+
+    char* allocate(size_t size);
+    void release(char* block, size_t size);
+
+    // Bytes a block of this size really occupies
+    static size_t blockSize(size_t size);
+    // Reservation a single block of this size needs in an empty arena
+    static size_t minReservation(size_t size);
+    // How much allocate(size) would add to the reserved bytes right now
+    size_t reservationCost(size_t size) const;
+
+    size_t getLiveBytes() const { return m_liveBytes; }
+    size_t getReservedBytes() const { return m_reservedBytes; }
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    struct Chunk {
+        char* memory = nullptr;
+        size_t classIndex = 0;
+        size_t liveBlocks = 0;
+        size_t carved = 0;              // bytes handed out at least once
+        FreeBlock* freeList = nullptr;
+        Chunk* prev = nullptr;          // in the list of its class' chunks with room
+        Chunk* next = nullptr;
+        bool listed = false;
+    };
+
+    static constexpr size_t MIN_BLOCK_SHIFT = 4;    // 16 bytes
+    static constexpr size_t MAX_BLOCK_SHIFT = 16;   // 64 KiB
+    static constexpr size_t CLASS_COUNT = MAX_BLOCK_SHIFT - MIN_BLOCK_SHIFT + 1;
+    // Chunks are aligned to their size, the chunk of a block is found by masking its address
+    static constexpr size_t CHUNK_SIZE = 256 * 1024;
+
+    static size_t classIndex(size_t size);
+    static bool hasRoom(const Chunk& chunk);
+    void link(Chunk& chunk);
+    void unlink(Chunk& chunk);
+    void freeChunk(Chunk& chunk);
+
+    Chunk* m_withRoom[CLASS_COUNT] = {};
+    std::unordered_map<uintptr_t, std::unique_ptr<Chunk>> m_chunks;
+    size_t m_liveBytes = 0;
+    size_t m_reservedBytes = 0;
+};
+
+// In-memory cache behind the /set, /get, /del, /incr and /expire commands.
+// Not synchronized: each reactor thread owns its own shard.
+class KeyValueStore {
+public:
+    static constexpr size_t DEFAULT_MAX_MEMORY = 64 * 1024 * 1024;
+    // Longest TTL /expire accepts, keeps the millisecond deadline far from overflow
+    static constexpr std::chrono::seconds MAX_TTL{10LL * 365 * 24 * 3600};
+
+    explicit KeyValueStore(size_t maxMemoryBytes = DEFAULT_MAX_MEMORY);
+    KeyValueStore(const KeyValueStore&) = delete;
+    KeyValueStore& operator=(const KeyValueStore&) = delete;
+    ~KeyValueStore();
+
+    // false when the pair alone does not fit into the memory limit
+    bool set(std::string_view key, std::string_view value);
+    // The view is valid until the next modification of the store
+    std::optional<std::string_view> get(std::string_view key);
+    bool del(std::string_view key);
+    // nullopt when the stored value is not a 64-bit integer
+    std::optional<int64_t> incr(std::string_view key);
+    // false when the key is missing or ttl is above MAX_TTL; ttl <= 0 deletes the key
+    bool expire(std::string_view key, std::chrono::milliseconds ttl);
+
+    // Incremental expiry, called once per event loop iteration
+    size_t expireCycle(size_t maxSlots = EXPIRE_SCAN_SLOTS);
+
+    void setMaxMemory(size_t maxMemoryBytes);
+    // Arena reservation plus the slot table: what the limit is enforced on
+    size_t getMemoryUsed() const;
+    size_t size() const { return m_count; }
+    KeyValueStats getStats() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t INITIAL_CAPACITY = 1024;
+    static constexpr size_t EXPIRE_SCAN_SLOTS = 256;
+    static constexpr size_t EVICTION_SAMPLES = 5;
+
+    // Key bytes followed by value bytes live in one arena block
+    struct Slot {
+        char* block = nullptr;
+        uint32_t hash = 0;
+        uint32_t keyLength = 0;
+        uint32_t valueLength = 0;
+        uint32_t lastAccess = 0;  // LRU clock value of the last hit
+        int64_t expireAt = 0;     // steady_clock ms, 0 - no expiry
+
+        std::string_view key() const { return {block, keyLength}; }
+        std::string_view value() const { return {block + keyLength, valueLength}; }
+    };
+
+    static uint32_t hashKey(std::string_view key);
+    static int64_t nowMs();
+
+    size_t mask() const { return m_slots.size() - 1; }
+    // Index of the key, or of the empty slot where it would be inserted
+    size_t findSlot(std::string_view key, uint32_t hash, bool& found) const;
+    // Lookup that drops the key when its TTL has passed
+    Slot* findLive(std::string_view key);
+    bool writeValue(std::string_view key, std::string_view value, bool keepTtl);
+    void eraseAt(size_t index);
+    // Bytes the slot table grows by before one more key is inserted, 0 when it has room
+    size_t growthBytes() const;
+    void grow();
+    // Evicts until a block of length bytes and the table growth fit into the limit
+    bool makeRoom(size_t length);
+    void evictOne();
+
+    std::vector<Slot> m_slots;
+    KeyValueArena m_arena;
+    size_t m_count = 0;
+    size_t m_volatileCount = 0;
+    size_t m_maxMemory;
+    size_t m_expireCursor = 0;
+    uint32_t m_lruClock = 0;
+    std::minstd_rand m_random;
+
+    uint64_t m_hits = 0;
+    uint64_t m_misses = 0;
+    uint64_t m_evictions = 0;
+    uint64_t m_expired = 0;
+};
+
+
+#endif //ASYNCSERVER_KEYVALUESTORE_H
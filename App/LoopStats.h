@@ -0,0 +1,149 @@
+//
+// Created by roach on 19.11.2025.
+//
+
+#ifndef ASYNCSERVER_LOOPSTATS_H
+#define ASYNCSERVER_LOOPSTATS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Kinds of work the reactor does between two epoll_wait calls
+enum class LoopHandler : size_t {
+    Accept,
+    TcpRead,
+    TcpWrite,
+    UdpRead,
+    UdpWrite,
+    Timers,
+    Tasks,
+    Upstream,
+    Count
+};
+
+inline const char* loopHandlerName(LoopHandler handler) {
+    switch (handler) {
+        case LoopHandler::Accept: return "accept";
+        case LoopHandler::TcpRead: return "tcp-read";
+        case LoopHandler::TcpWrite: return "tcp-write";
+        case LoopHandler::UdpRead: return "udp-read";
+        case LoopHandler::UdpWrite: return "udp-write";
+        case LoopHandler::Timers: return "timers";
+        case LoopHandler::Tasks: return "tasks";
+        case LoopHandler::Upstream: return "upstream";
+        default: return "unknown";
+    }
+}
+
+// Event loop health counters. Written only by the reactor thread, so updates are plain
+// load+store without locked instructions; other threads read them relaxed.
+class LoopStats {
+public:
+    static constexpr size_t HANDLER_COUNT = static_cast<size_t>(LoopHandler::Count);
+
+    struct HandlerTotals {
+        uint64_t calls = 0;
+        uint64_t totalNs = 0;
+        uint64_t maxNs = 0;
+    };
+
+    void recordWait(uint64_t waitNs, int events) {
+        add(m_iterations, 1);
+        add(m_idleNs, waitNs);
+        if (events > 0) {
+            add(m_wakeups, 1);
+            add(m_events, static_cast<uint64_t>(events));
+            raise(m_maxEventsPerWakeup, static_cast<uint64_t>(events));
+        }
+    }
+    // Time from epoll_wait returning to the next epoll_wait: how late a ready fd may be noticed
+    void recordBusy(uint64_t busyNs) {
+        add(m_busyNs, busyNs);
+        raise(m_maxLagNs, busyNs);
+        m_lastLagNs.store(busyNs, std::memory_order_relaxed);
+    }
+    void recordHandler(LoopHandler handler, uint64_t ns) {
+        Handler& h = m_handlers[static_cast<size_t>(handler)];
+        add(h.calls, 1);
+        add(h.totalNs, ns);
+        raise(h.maxNs, ns);
+    }
+    void slowCallback() { add(m_slowCallbacks, 1); }
+    // A client stopped reading at its per-iteration budget and was queued for the next pass
+    void readYield() { add(m_readYields, 1); }
+    // Events moved to the front of a batch for priority lane clients
+    void recordPriorityEvents(uint64_t events) { add(m_priorityEvents, events); }
+    // Busy poll mode: zero-timeout polls (empty ones are pure spinning) vs blocking waits
+    void recordPoll(bool spin, int events) {
+        if (!spin) {
+            add(m_blockingWaits, 1);
+        } else if (events > 0) {
+            add(m_spinHits, 1);
+        } else {
+            add(m_spinMisses, 1);
+        }
+    }
+
+    uint64_t getIterations() const { return m_iterations.load(std::memory_order_relaxed); }
+    uint64_t getWakeups() const { return m_wakeups.load(std::memory_order_relaxed); }
+    uint64_t getEvents() const { return m_events.load(std::memory_order_relaxed); }
+    uint64_t getMaxEventsPerWakeup() const { return m_maxEventsPerWakeup.load(std::memory_order_relaxed); }
+    uint64_t getIdleNs() const { return m_idleNs.load(std::memory_order_relaxed); }
+    uint64_t getBusyNs() const { return m_busyNs.load(std::memory_order_relaxed); }
+    uint64_t getLastLagNs() const { return m_lastLagNs.load(std::memory_order_relaxed); }
+    uint64_t getMaxLagNs() const { return m_maxLagNs.load(std::memory_order_relaxed); }
+    uint64_t getSlowCallbacks() const { return m_slowCallbacks.load(std::memory_order_relaxed); }
+    uint64_t getReadYields() const { return m_readYields.load(std::memory_order_relaxed); }
+    uint64_t getPriorityEvents() const { return m_priorityEvents.load(std::memory_order_relaxed); }
+    uint64_t getSpinHits() const { return m_spinHits.load(std::memory_order_relaxed); }
+    uint64_t getSpinMisses() const { return m_spinMisses.load(std::memory_order_relaxed); }
+    uint64_t getBlockingWaits() const { return m_blockingWaits.load(std::memory_order_relaxed); }
+    void setBusyPollEnabled(bool enabled) { m_busyPollEnabled.store(enabled, std::memory_order_relaxed); }
+    bool isBusyPollEnabled() const { return m_busyPollEnabled.load(std::memory_order_relaxed); }
+    HandlerTotals getHandler(LoopHandler handler) const {
+        const Handler& h = m_handlers[static_cast<size_t>(handler)];
+        return {h.calls.load(std::memory_order_relaxed), h.totalNs.load(std::memory_order_relaxed),
+                h.maxNs.load(std::memory_order_relaxed)};
+    }
+
+    void setSlowThresholdNs(uint64_t ns) { m_slowThresholdNs.store(ns, std::memory_order_relaxed); }
+    uint64_t getSlowThresholdNs() const { return m_slowThresholdNs.load(std::memory_order_relaxed); }
+
+private:
+    struct Handler {
+        std::atomic<uint64_t> calls{0};
+        std::atomic<uint64_t> totalNs{0};
+        std::atomic<uint64_t> maxNs{0};
+    };
+
+    static void add(std::atomic<uint64_t>& counter, uint64_t value) {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+    static void raise(std::atomic<uint64_t>& counter, uint64_t value) {
+        if (value > counter.load(std::memory_order_relaxed)) {
+            counter.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    std::atomic<uint64_t> m_iterations{0};
+    std::atomic<uint64_t> m_wakeups{0};
+    std::atomic<uint64_t> m_events{0};
+    std::atomic<uint64_t> m_maxEventsPerWakeup{0};
+    std::atomic<uint64_t> m_idleNs{0};
+    std::atomic<uint64_t> m_busyNs{0};
+    std::atomic<uint64_t> m_lastLagNs{0};
+    std::atomic<uint64_t> m_maxLagNs{0};
+    std::atomic<uint64_t> m_slowCallbacks{0};
+    std::atomic<uint64_t> m_slowThresholdNs{10'000'000};
+    std::atomic<uint64_t> m_readYields{0};
+    std::atomic<uint64_t> m_priorityEvents{0};
+    std::atomic<uint64_t> m_spinHits{0};
+    std::atomic<uint64_t> m_spinMisses{0};
+    std::atomic<uint64_t> m_blockingWaits{0};
+    std::atomic<bool> m_busyPollEnabled{false};
+    Handler m_handlers[HANDLER_COUNT];
+};
+
+
+#endif //ASYNCSERVER_LOOPSTATS_H
@@ -0,0 +1,415 @@
+//
+// Created by roach on 19.11.2025.
+//
+
+#include "LoopbackTransport.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <sys/un.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace {
+    constexpr std::string_view DATAGRAM_PREFIX = "loopback/";
+
+    // Datagram clients are named by their fd, so replies find their way back without a lookup table
+    void datagramAddress(int fd, PeerAddress& addr) {
+        auto* unixAddr = reinterpret_cast<sockaddr_un*>(addr.get());
+        std::string path = std::string(DATAGRAM_PREFIX) + std::to_string(fd);
+        unixAddr->sun_family = AF_UNIX;
+        std::memcpy(unixAddr->sun_path, path.c_str(), path.size() + 1);
+        addr.length = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + path.size() + 1);
+    }
+    int datagramPeer(const sockaddr* addr, socklen_t length) {
+        const auto* unixAddr = reinterpret_cast<const sockaddr_un*>(addr);
+        if (!addr || length <= offsetof(sockaddr_un, sun_path) + DATAGRAM_PREFIX.size() || unixAddr->sun_family != AF_UNIX
+            || std::string_view(unixAddr->sun_path).substr(0, DATAGRAM_PREFIX.size()) != DATAGRAM_PREFIX) {
+            return -1;
+        }
+        return static_cast<int>(std::strtol(unixAddr->sun_path + DATAGRAM_PREFIX.size(), nullptr, 10));
+    }
+}
+
+LoopbackTransport::LoopbackTransport() : EPollManager(Simulated{}) {
+    m_listen_fd = allocate();
+    m_datagram_fd = allocate();
+    find(m_datagram_fd)->datagram = true;
+}
+int LoopbackTransport::connect() {
+    int server = allocate();
+    int client = allocate();
+    find(server)->peer = client;
+    find(client)->peer = server;
+    m_backlog.push_back(server);
+    signal(m_listen_fd, EPOLLIN);
+    return client;
+}
+void LoopbackTransport::write(int client, std::string_view data) {
+    Endpoint* endpoint = find(client);
+    if (!endpoint || !endpoint->open || data.empty()) {
+        return;
+    }
+    Endpoint& server = *find(endpoint->peer);
+    if (!server.open) {
+        return;
+    }
+    server.input.append(data);
+    signal(endpoint->peer, EPOLLIN);
+}
+std::string LoopbackTransport::read(int client) {
+    Endpoint* endpoint = find(client);
+    if (!endpoint) {
+        return {};
+    }
+    std::string data = endpoint->input.substr(endpoint->inputOffset);
+    endpoint->input.clear();
+    endpoint->inputOffset = 0;
+    if (m_clientBufferLimit && !data.empty()) {
+        // Room in a full buffer is what EPOLLOUT waits for
+        signal(endpoint->peer, EPOLLOUT);
+    }
+    return data;
+}
+size_t LoopbackTransport::readable(int client) const {
+    const Endpoint* endpoint = find(client);
+    return endpoint ? endpoint->input.size() - endpoint->inputOffset : 0;
+}
+void LoopbackTransport::disconnect(int client) {
+    Endpoint* endpoint = find(client);
+    if (!endpoint || !endpoint->open) {
+        return;
+    }
+    endpoint->open = false;
+    endpoint->input.clear();
+    endpoint->inputOffset = 0;
+    find(endpoint->peer)->peerClosed = true;
+    signal(endpoint->peer, EPOLLIN | EPOLLRDHUP);
+}
+bool LoopbackTransport::isOpen(int client) const {
+    const Endpoint* endpoint = find(client);
+    return endpoint && endpoint->open && !endpoint->peerClosed;
+}
+int LoopbackTransport::connectDatagram() {
+    int client = allocate();
+    find(client)->datagram = true;
+    return client;
+}
+void LoopbackTransport::sendDatagram(int client, std::string_view data) {
+    Endpoint* endpoint = find(client);
+    Endpoint& server = *find(m_datagram_fd);
+    if (!endpoint || !endpoint->datagram || !server.open) {
+        return;
+    }
+    server.datagrams.push_back({client, std::string(data)});
+    server.datagramBytes += data.size();
+    signal(m_datagram_fd, EPOLLIN);
+}
+std::vector<std::string> LoopbackTransport::receiveDatagrams(int client) {
+    std::vector<std::string> result;
+    Endpoint* endpoint = find(client);
+    if (!endpoint || !endpoint->datagram) {
+        return result;
+    }
+    for (Datagram& datagram : endpoint->datagrams) {
+        result.push_back(std::move(datagram.data));
+    }
+    endpoint->datagrams.clear();
+    endpoint->datagramBytes = 0;
+    if (m_clientBufferLimit && !result.empty()) {
+        signal(m_datagram_fd, EPOLLOUT);
+    }
+    return result;
+}
+void LoopbackTransport::addFD(int fd, uint32_t events) {
+    Endpoint* endpoint = find(fd);
+    if (!endpoint || !endpoint->open) {
+        throw std::system_error(EBADF, std::system_category(), "loopback ADD failed");
+    }
+    endpoint->registered = true;
+    endpoint->interest = events;
+    // Like epoll, registration reports the state the fd is already in
+    if (fd == m_listen_fd) {
+        if (!m_backlog.empty()) {
+            signal(fd, EPOLLIN);
+        }
+        return;
+    }
+    if (endpoint->input.size() > endpoint->inputOffset || !endpoint->datagrams.empty() || endpoint->peerClosed) {
+        signal(fd, endpoint->peerClosed ? EPOLLIN | EPOLLRDHUP : EPOLLIN);
+    }
+    signal(fd, EPOLLOUT);
+}
+void LoopbackTransport::modifyFD(int fd, uint32_t events) {
+    Endpoint* endpoint = find(fd);
+    if (!endpoint || !endpoint->registered) {
+        throw std::system_error(ENOENT, std::system_category(), "loopback MODIFY for fd " + std::to_string(fd));
+    }
+    endpoint->interest = events;
+    // EPOLL_CTL_MOD re-arms the edge: a writable socket reports EPOLLOUT right away.
+    // A datagram endpoint has no single peer, a full receiver answers the retry with EAGAIN again.
+    const Endpoint* peer = find(endpoint->peer);
+    if (endpoint->datagram
+        || (peer && (!m_clientBufferLimit || peer->input.size() - peer->inputOffset < m_clientBufferLimit))) {
+        signal(fd, EPOLLOUT);
+    }
+    if (endpoint->input.size() > endpoint->inputOffset || !endpoint->datagrams.empty()) {
+        signal(fd, EPOLLIN);
+    }
+}
+void LoopbackTransport::removeFD(int fd) {
+    if (Endpoint* endpoint = find(fd)) {
+        endpoint->registered = false;
+        endpoint->ready = 0;
+    }
+}
+int LoopbackTransport::waitForEvents(epoll_event *events, int maxEvents, int timeout) {
+    if (maxEvents <= 0) {
+        throw std::invalid_argument("maxEvents must be positive");
+    }
+    (void)timeout;
+    if (m_readyList.empty() && !m_wakeupPending.load(std::memory_order_acquire) && m_idleHook) {
+        m_idleHook();
+    }
+
+    int count = 0;
+    if (m_wakeup_fd != -1 && m_wakeupPending.load(std::memory_order_acquire)) {
+        events[count].events = EPOLLIN;
+        events[count].data.fd = m_wakeup_fd;
+        ++count;
+    }
+    while (count < maxEvents && !m_readyList.empty()) {
+        int fd = m_readyList.front();
+        m_readyList.pop_front();
+        Endpoint& endpoint = *find(fd);
+        endpoint.queued = false;
+        if (!endpoint.registered || endpoint.ready == 0) {
+            continue;
+        }
+        events[count].events = endpoint.ready;
+        events[count].data.fd = fd;
+        endpoint.ready = 0;
+        ++count;
+    }
+    return count;
+}
+int LoopbackTransport::enableWakeup() {
+    if (m_wakeup_fd == -1) {
+        m_wakeup_fd = allocate();
+    }
+    return m_wakeup_fd;
+}
+void LoopbackTransport::wakeup() {
+    m_wakeupPending.store(true, std::memory_order_release);
+}
+void LoopbackTransport::clearWakeup() {
+    m_wakeupPending.store(false, std::memory_order_release);
+}
+int LoopbackTransport::accept(int listen_fd, PeerAddress &addr) {
+    if (listen_fd != m_listen_fd) {
+        errno = EBADF;
+        return -1;
+    }
+    if (m_backlog.empty()) {
+        errno = EAGAIN;
+        return -1;
+    }
+    int fd = m_backlog.front();
+    m_backlog.pop_front();
+
+    auto* unixAddr = reinterpret_cast<sockaddr_un*>(addr.get());
+    unixAddr->sun_family = AF_UNIX;
+    std::strcpy(unixAddr->sun_path, "loopback");
+    addr.length = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + sizeof("loopback"));
+    return fd;
+}
+ssize_t LoopbackTransport::recv(int fd, char *buffer, size_t length) {
+    Endpoint* endpoint = find(fd);
+    if (!endpoint || !endpoint->open) {
+        errno = EBADF;
+        return -1;
+    }
+    size_t available = endpoint->input.size() - endpoint->inputOffset;
+    if (available == 0) {
+        if (endpoint->peerClosed) {
+            return 0;
+        }
+        errno = EAGAIN;
+        return -1;
+    }
+    size_t bytes = std::min(available, length);
+    std::memcpy(buffer, endpoint->input.data() + endpoint->inputOffset, bytes);
+    endpoint->inputOffset += bytes;
+    consumed(*endpoint);
+    return static_cast<ssize_t>(bytes);
+}
+ssize_t LoopbackTransport::send(int fd, const char *data, size_t length) {
+    iovec iov{const_cast<char*>(data), length};
+    return deliver(fd, &iov, 1);
+}
+ssize_t LoopbackTransport::sendv(int fd, const iovec *iov, size_t count) {
+    return deliver(fd, iov, count);
+}
+ssize_t LoopbackTransport::sendfile(int fd, int file_fd, off_t *offset, size_t count) {
+    // File bytes still come from the page cache, only the connection is simulated
+    constexpr size_t CHUNK = 64 * 1024;
+    std::string buffer(std::min(count, CHUNK), '\0');
+    ssize_t bytes = ::pread(file_fd, buffer.data(), buffer.size(), *offset);
+    if (bytes <= 0) {
+        return bytes;
+    }
+    iovec iov{buffer.data(), static_cast<size_t>(bytes)};
+    ssize_t sent = deliver(fd, &iov, 1);
+    if (sent > 0) {
+        *offset += sent;
+    }
+    return sent;
+}
+int LoopbackTransport::close(int fd) {
+    Endpoint* endpoint = find(fd);
+    if (!endpoint || !endpoint->open) {
+        errno = EBADF;
+        return -1;
+    }
+    endpoint->open = false;
+    endpoint->registered = false;
+    endpoint->ready = 0;
+    endpoint->input.clear();
+    endpoint->inputOffset = 0;
+    endpoint->datagrams.clear();
+    endpoint->datagramBytes = 0;
+    if (Endpoint* peer = find(endpoint->peer)) {
+        peer->peerClosed = true;
+    }
+    return 0;
+}
+ssize_t LoopbackTransport::recvfrom(int fd, char *buffer, size_t length, PeerAddress &addr) {
+    Endpoint* endpoint = find(fd);
+    if (!endpoint || !endpoint->open || !endpoint->datagram) {
+        errno = EBADF;
+        return -1;
+    }
+    if (endpoint->datagrams.empty()) {
+        errno = EAGAIN;
+        return -1;
+    }
+    Datagram datagram = std::move(endpoint->datagrams.front());
+    endpoint->datagrams.pop_front();
+    endpoint->datagramBytes -= datagram.data.size();
+    // Like UDP, the part that does not fit the buffer is lost
+    size_t bytes = std::min(datagram.data.size(), length);
+    std::memcpy(buffer, datagram.data.data(), bytes);
+    datagramAddress(datagram.from, addr);
+    return static_cast<ssize_t>(bytes);
+}
+ssize_t LoopbackTransport::sendto(int fd, const char *data, size_t length, const PeerAddress &addr) {
+    Endpoint* endpoint = find(fd);
+    if (!endpoint || !endpoint->open || !endpoint->datagram) {
+        errno = EBADF;
+        return -1;
+    }
+    int to = datagramPeer(addr.get(), addr.length);
+    Endpoint* peer = find(to);
+    if (!peer || !peer->datagram || !peer->open) {
+        errno = ECONNREFUSED;
+        return -1;
+    }
+    if (m_clientBufferLimit && peer->datagramBytes >= m_clientBufferLimit) {
+        errno = EAGAIN;
+        return -1;
+    }
+    peer->datagrams.push_back({fd, std::string(data, length)});
+    peer->datagramBytes += length;
+    return static_cast<ssize_t>(length);
+}
+int LoopbackTransport::sendmmsg(int fd, mmsghdr *messages, unsigned int count) {
+    unsigned int sent = 0;
+    for (; sent < count; ++sent) {
+        msghdr& header = messages[sent].msg_hdr;
+        std::string data;
+        for (size_t i = 0; i < header.msg_iovlen; ++i) {
+            data.append(static_cast<const char*>(header.msg_iov[i].iov_base), header.msg_iov[i].iov_len);
+        }
+        PeerAddress addr;
+        addr.length = std::min<socklen_t>(header.msg_namelen, sizeof(addr.storage));
+        if (header.msg_name) {
+            std::memcpy(addr.get(), header.msg_name, addr.length);
+        }
+        ssize_t bytes = sendto(fd, data.data(), data.size(), addr);
+        if (bytes == -1) {
+            // Like the syscall: an error is reported only when nothing was sent
+            return sent == 0 ? -1 : static_cast<int>(sent);
+        }
+        messages[sent].msg_len = static_cast<unsigned int>(bytes);
+    }
+    return static_cast<int>(sent);
+}
+int LoopbackTransport::allocate() {
+    m_endpoints.emplace_back();
+    return FIRST_FD + static_cast<int>(m_endpoints.size() - 1);
+}
+LoopbackTransport::Endpoint* LoopbackTransport::find(int fd) {
+    size_t index = static_cast<size_t>(fd - FIRST_FD);
+    return fd >= FIRST_FD && index < m_endpoints.size() ? &m_endpoints[index] : nullptr;
+}
+const LoopbackTransport::Endpoint* LoopbackTransport::find(int fd) const {
+    size_t index = static_cast<size_t>(fd - FIRST_FD);
+    return fd >= FIRST_FD && index < m_endpoints.size() ? &m_endpoints[index] : nullptr;
+}
+void LoopbackTransport::signal(int fd, uint32_t events) {
+    Endpoint* endpoint = find(fd);
+    if (!endpoint || !endpoint->registered) {
+        return;
+    }
+    uint32_t ready = events & (endpoint->interest | EPOLLERR | EPOLLHUP);
+    if (ready == 0) {
+        return;
+    }
+    endpoint->ready |= ready;
+    if (!endpoint->queued) {
+        endpoint->queued = true;
+        m_readyList.push_back(fd);
+    }
+}
+ssize_t LoopbackTransport::deliver(int fd, const iovec *iov, size_t count) {
+    Endpoint* endpoint = find(fd);
+    if (!endpoint || !endpoint->open) {
+        errno = EBADF;
+        return -1;
+    }
+    Endpoint& peer = *find(endpoint->peer);
+    if (!peer.open) {
+        errno = EPIPE;
+        return -1;
+    }
+
+    size_t space = SIZE_MAX;
+    if (m_clientBufferLimit) {
+        size_t unread = peer.input.size() - peer.inputOffset;
+        space = unread < m_clientBufferLimit ? m_clientBufferLimit - unread : 0;
+        if (space == 0) {
+            errno = EAGAIN;
+            return -1;
+        }
+    }
+    size_t total = 0;
+    for (size_t i = 0; i < count && total < space; ++i) {
+        size_t bytes = std::min(iov[i].iov_len, space - total);
+        peer.input.append(static_cast<const char*>(iov[i].iov_base), bytes);
+        total += bytes;
+    }
+    return static_cast<ssize_t>(total);
+}
+void LoopbackTransport::consumed(Endpoint &endpoint) {
+    if (endpoint.inputOffset == endpoint.input.size()) {
+        endpoint.input.clear();
+        endpoint.inputOffset = 0;
+    } else if (endpoint.inputOffset >= 64 * 1024) {
+        // Drop the consumed prefix once it is worth a copy
+        endpoint.input.erase(0, endpoint.inputOffset);
+        endpoint.inputOffset = 0;
+    }
+}
@@ -0,0 +1,118 @@
+//
+// Created by roach on 19.11.2025.
+//
+
+#ifndef ASYNCSERVER_LOOPBACKTRANSPORT_H
+#define ASYNCSERVER_LOOPBACKTRANSPORT_H
+
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "AsyncServer.h"
+
+// In-process stand-in for the kernel under TCPServer and UDPServer: every connection is a pair of
+// byte buffers, datagrams are queued whole per receiver, and readiness is simulated with
+// edge-triggered semantics, so the whole AsyncServer pipeline runs
+// without a syscall per message. Single-threaded: the driver (a benchmark or test) feeds clients
+// from the idle hook, which the reactor calls whenever it would otherwise block in epoll_wait.
+// Only wakeup() may be called from other threads.
+class LoopbackTransport final : public EPollManager, public Transport {
+public:
+    using IdleHook = std::function<void()>;
+
+    LoopbackTransport();
+
+    // Client side
+    int connect();
+    void write(int client, std::string_view data);
+    // Everything the server has sent to this client since the last call
+    std::string read(int client);
+    size_t readable(int client) const;
+    // Closes the client end; the server sees EOF
+    void disconnect(int client);
+    // false once the server has closed the connection
+    bool isOpen(int client) const;
+
+    // Datagram client: an address the server's datagram endpoint receives from and replies to
+    int connectDatagram();
+    void sendDatagram(int client, std::string_view data);
+    // Datagrams the server has sent to this client since the last call, oldest first
+    std::vector<std::string> receiveDatagrams(int client);
+
+    int getListenFD() const { return m_listen_fd; }
+    int getDatagramFD() const { return m_datagram_fd; }
+    void setIdleHook(IdleHook hook) { m_idleHook = std::move(hook); }
+    // Bytes a client may have unread before server sends hit EAGAIN, 0 - unlimited.
+    // Datagrams count whole, like a full socket buffer they block the server's send queue.
+    void setClientBufferLimit(size_t bytes) { m_clientBufferLimit = bytes; }
+
+    // Readiness source
+    void addFD(int fd, uint32_t events) override;
+    void modifyFD(int fd, uint32_t events) override;
+    void removeFD(int fd) override;
+    // Never blocks: returns what is ready after running the idle hook, possibly nothing
+    int waitForEvents(epoll_event* events, int maxEvents, int timeout = -1) override;
+    int enableWakeup() override;
+    void wakeup() override;
+    void clearWakeup() override;
+
+    // Server side of the connections
+    int accept(int listen_fd, PeerAddress& addr) override;
+    ssize_t recv(int fd, char* buffer, size_t length) override;
+    ssize_t send(int fd, const char* data, size_t length) override;
+    ssize_t sendv(int fd, const iovec* iov, size_t count) override;
+    ssize_t sendfile(int fd, int file_fd, off_t* offset, size_t count) override;
+    int close(int fd) override;
+
+    // Server side of the datagram endpoint; peers are AF_UNIX addresses naming the client
+    ssize_t recvfrom(int fd, char* buffer, size_t length, PeerAddress& addr) override;
+    ssize_t sendto(int fd, const char* data, size_t length, const PeerAddress& addr) override;
+    int sendmmsg(int fd, mmsghdr* messages, unsigned int count) override;
+
+private:
+    // Far above real descriptors so a stray kernel call on one fails instead of hitting a real file
+    static constexpr int FIRST_FD = 1 << 20;
+
+    struct Datagram {
+        int from;
+        std::string data;
+    };
+
+    struct Endpoint {
+        std::string input;            // bytes written by the peer, not yet read
+        size_t inputOffset = 0;
+        std::deque<Datagram> datagrams;
+        size_t datagramBytes = 0;
+        int peer = -1;
+        bool datagram = false;
+        bool open = true;
+        bool peerClosed = false;
+        bool registered = false;
+        uint32_t interest = 0;
+        uint32_t ready = 0;           // edges not yet reported by waitForEvents
+        bool queued = false;          // on m_readyList
+    };
+
+    int allocate();
+    Endpoint* find(int fd);
+    const Endpoint* find(int fd) const;
+    // Raises an edge on fd if it is registered for it
+    void signal(int fd, uint32_t events);
+    // Appends to the peer's input; short or EAGAIN when a client buffer is full
+    ssize_t deliver(int fd, const iovec* iov, size_t count);
+    void consumed(Endpoint& endpoint);
+
+    std::vector<Endpoint> m_endpoints;
+    std::deque<int> m_backlog;
+    std::deque<int> m_readyList;
+    int m_listen_fd = -1;
+    int m_datagram_fd = -1;
+    size_t m_clientBufferLimit = 0;
+    IdleHook m_idleHook;
+};
+
+
+#endif //ASYNCSERVER_LOOPBACKTRANSPORT_H
@@ -0,0 +1,114 @@
+//
+// Created by roach on 19.11.2025.
+//
+
+#include "PubSub.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace {
+    // Order inside the vectors does not matter, so removal is swap-and-pop
+    template<typename T>
+    bool swapRemove(std::vector<T>& items, const T& value) {
+        auto it = std::find(items.begin(), items.end(), value);
+        if (it == items.end()) {
+            return false;
+        }
+        *it = std::move(items.back());
+        items.pop_back();
+        return true;
+    }
+}
+
+bool PubSub::subscribe(int client_fd, const std::string &topic) {
+    auto& subscribers = m_topics[topic];
+    if (std::find(subscribers.begin(), subscribers.end(), client_fd) != subscribers.end()) {
+        return false;
+    }
+    subscribers.push_back(client_fd);
+    m_clientTopics[client_fd].push_back(topic);
+    std::cout << "PubSub: client " << client_fd << " subscribed to '" << topic << "'" << std::endl;
+    return true;
+}
+bool PubSub::unsubscribe(int client_fd, const std::string &topic) {
+    auto topic_it = m_topics.find(topic);
+    if (topic_it == m_topics.end() || !swapRemove(topic_it->second, client_fd)) {
+        return false;
+    }
+    if (topic_it->second.empty()) {
+        m_topics.erase(topic_it);
+    }
+
+    auto client_it = m_clientTopics.find(client_fd);
+    if (client_it != m_clientTopics.end()) {
+        swapRemove(client_it->second, topic);
+        if (client_it->second.empty()) {
+            m_clientTopics.erase(client_it);
+        }
+    }
+    return true;
+}
+void PubSub::removeClient(int client_fd) {
+    // accept() may hand the fd number to a new client before the fan-outs reach it
+    for (auto& delivery : m_pending) {
+        std::replace(delivery.subscribers.begin() + static_cast<std::ptrdiff_t>(delivery.next),
+                     delivery.subscribers.end(), client_fd, -1);
+    }
+
+    auto client_it = m_clientTopics.find(client_fd);
+    if (client_it == m_clientTopics.end()) {
+        return;
+    }
+    for (const auto& topic : client_it->second) {
+        auto topic_it = m_topics.find(topic);
+        if (topic_it == m_topics.end()) {
+            continue;
+        }
+        swapRemove(topic_it->second, client_fd);
+        if (topic_it->second.empty()) {
+            m_topics.erase(topic_it);
+        }
+    }
+    m_clientTopics.erase(client_it);
+}
+size_t PubSub::publish(const std::string &topic, const std::string &message) {
+    auto topic_it = m_topics.find(topic);
+    if (topic_it == m_topics.end()) {
+        return 0;
+    }
+
+    Delivery delivery;
+    delivery.buffer = std::make_shared<const std::string>(topic + ": " + message + "\n");
+    delivery.subscribers = topic_it->second;
+    const size_t count = delivery.subscribers.size();
+
+    if (m_pending.empty() && count <= FANOUT_CHUNK) {
+        // Small topic and nothing queued ahead of it: deliver right away
+        for (int client_fd : delivery.subscribers) {
+            m_tcpServer->sendShared(client_fd, delivery.buffer);
+        }
+        return count;
+    }
+
+    m_pending.push_back(std::move(delivery));
+    return count;
+}
+void PubSub::runPending() {
+    size_t budget = FANOUT_CHUNK;
+    while (budget > 0 && !m_pending.empty()) {
+        Delivery& delivery = m_pending.front();
+        size_t end = std::min(delivery.subscribers.size(), delivery.next + budget);
+        for (; delivery.next < end; ++delivery.next) {
+            // Subscribers that left since the snapshot were replaced with -1 by removeClient
+            int client_fd = delivery.subscribers[delivery.next];
+            if (client_fd != -1) {
+                m_tcpServer->sendShared(client_fd, delivery.buffer);
+            }
+            --budget;
+        }
+        if (delivery.next == delivery.subscribers.size()) {
+            m_pending.pop_front();
+        }
+    }
+}
@@ -0,0 +1,52 @@
+//
+// Created by roach on 19.11.2025.
+//
+
+#ifndef ASYNCSERVER_PUBSUB_H
+#define ASYNCSERVER_PUBSUB_H
+
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "AsyncServer.h"
+
+// Topic subscriptions of TCP clients. A published message is serialized once and the same
+// refcounted buffer is queued to every subscriber; large fan-outs are spread over loop iterations.
+class PubSub {
+public:
+    explicit PubSub(TCPServer* tcpServer) : m_tcpServer(tcpServer) {}
+    PubSub(const PubSub&) = delete;
+    PubSub& operator=(const PubSub&) = delete;
+
+    bool subscribe(int client_fd, const std::string& topic);
+    bool unsubscribe(int client_fd, const std::string& topic);
+    void removeClient(int client_fd);
+
+    // Returns the number of subscribers the message is addressed to
+    size_t publish(const std::string& topic, const std::string& message);
+
+    // Continues pending fan-outs, at most FANOUT_CHUNK sends per call
+    void runPending();
+    bool hasPending() const { return !m_pending.empty(); }
+
+    size_t getTopicCount() const { return m_topics.size(); }
+
+private:
+    static constexpr size_t FANOUT_CHUNK = 1024;
+
+    struct Delivery {
+        TCPServer::SharedBuffer buffer;
+        std::vector<int> subscribers;  // snapshot taken at publish time, -1 - left since
+        size_t next = 0;
+    };
+
+    TCPServer* m_tcpServer;
+    std::unordered_map<std::string, std::vector<int>> m_topics;
+    std::unordered_map<int, std::vector<std::string>> m_clientTopics;
+    std::deque<Delivery> m_pending;
+};
+
+
+#endif //ASYNCSERVER_PUBSUB_H
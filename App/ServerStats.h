@@ -5,11 +5,66 @@
 #ifndef ASYNCSERVER_SERVERSTATS_H
 #define ASYNCSERVER_SERVERSTATS_H
 
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+#include "LoopStats.h"
+
+struct KeyValueStats {
+    size_t keys = 0;
+    size_t memoryUsed = 0;
+    size_t memoryLimit = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t expired = 0;
+};
+
+// Log2 histogram of latencies: bucket i counts values below 2^i microseconds
+struct LatencySketch {
+    static constexpr size_t BUCKETS = 24;
+    std::array<uint32_t, BUCKETS> counts{};
+
+    void add(uint64_t ns) {
+        size_t bucket = std::min<size_t>(std::bit_width(ns / 1000), BUCKETS - 1);
+        ++counts[bucket];
+    }
+    // Upper bound of the bucket holding quantile q, microseconds
+    uint64_t quantileUs(double q) const {
+        uint64_t total = 0;
+        for (uint32_t count : counts) total += count;
+        if (total == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(total - 1)) + 1;
+        for (size_t bucket = 0; bucket < BUCKETS; ++bucket) {
+            if (counts[bucket] >= rank) return uint64_t{1} << bucket;
+            rank -= counts[bucket];
+        }
+        return uint64_t{1} << (BUCKETS - 1);
+    }
+};
 
 class ServerStats {
     std::atomic<size_t> m_total_clients;
     std::atomic<size_t> m_current_clients;
+
+    // Copied from the reactor's KeyValueStore, read by the console thread
+    std::atomic<size_t> m_kv_keys{0};
+    std::atomic<size_t> m_kv_memory_used{0};
+    std::atomic<size_t> m_kv_memory_limit{0};
+    std::atomic<uint64_t> m_kv_hits{0};
+    std::atomic<uint64_t> m_kv_misses{0};
+    std::atomic<uint64_t> m_kv_evictions{0};
+    std::atomic<uint64_t> m_kv_expired{0};
+
+    std::atomic<size_t> m_udp_queue_depth{0};
+    std::atomic<uint64_t> m_udp_deferred{0};
+    std::atomic<uint64_t> m_udp_dropped{0};
+
+    LoopStats m_loop;
 public:
     ServerStats() : m_total_clients(0), m_current_clients(0) {}
 
@@ -20,7 +75,42 @@ public:
     void clientDisconnected() { --m_current_clients; }
     size_t getTotalClients() const { return m_total_clients; }
     size_t getCurrentClients() const { return m_current_clients; }
+
+    void setKeyValueStats(const KeyValueStats& kv) {
+        m_kv_keys.store(kv.keys, std::memory_order_relaxed);
+        m_kv_memory_used.store(kv.memoryUsed, std::memory_order_relaxed);
+        m_kv_memory_limit.store(kv.memoryLimit, std::memory_order_relaxed);
+        m_kv_hits.store(kv.hits, std::memory_order_relaxed);
+        m_kv_misses.store(kv.misses, std::memory_order_relaxed);
+        m_kv_evictions.store(kv.evictions, std::memory_order_relaxed);
+        m_kv_expired.store(kv.expired, std::memory_order_relaxed);
+    }
+    KeyValueStats getKeyValueStats() const {
+        KeyValueStats kv;
+        kv.keys = m_kv_keys.load(std::memory_order_relaxed);
+        kv.memoryUsed = m_kv_memory_used.load(std::memory_order_relaxed);
+        kv.memoryLimit = m_kv_memory_limit.load(std::memory_order_relaxed);
+        kv.hits = m_kv_hits.load(std::memory_order_relaxed);
+        kv.misses = m_kv_misses.load(std::memory_order_relaxed);
+        kv.evictions = m_kv_evictions.load(std::memory_order_relaxed);
+        kv.expired = m_kv_expired.load(std::memory_order_relaxed);
+        return kv;
+    }
+
+    // UDP responses that hit EAGAIN and waited for EPOLLOUT / were dropped on a full queue
+    void udpResponseDeferred() { m_udp_deferred.fetch_add(1, std::memory_order_relaxed); }
+    void udpResponseDropped() { m_udp_dropped.fetch_add(1, std::memory_order_relaxed); }
+    // Sum over all UDP servers, each one reports the change of its own queue
+    void adjustUdpQueueDepth(ptrdiff_t delta) {
+        m_udp_queue_depth.fetch_add(static_cast<size_t>(delta), std::memory_order_relaxed);
+    }
+    size_t getUdpQueueDepth() const { return m_udp_queue_depth.load(std::memory_order_relaxed); }
+    uint64_t getUdpDeferred() const { return m_udp_deferred.load(std::memory_order_relaxed); }
+    uint64_t getUdpDropped() const { return m_udp_dropped.load(std::memory_order_relaxed); }
+
+    LoopStats& getLoopStats() { return m_loop; }
+    const LoopStats& getLoopStats() const { return m_loop; }
 };
 
 
-#endif //ASYNCSERVER_SERVERSTATS_H
\ No newline at end of file
+#endif //ASYNCSERVER_SERVERSTATS_H
@@ -0,0 +1,268 @@
+//
+// Created by roach on 19.11.2025.
+//
+
+#include "Session.h"
+
+#include <algorithm>
+#include <iostream>
+#include <new>
+
+#include "AsyncServer.h"
+
+namespace {
+    thread_local FramePool* t_currentPool = nullptr;
+
+    // Makes the session manager's pool current while a handler runs on this thread
+    class FramePoolScope {
+    public:
+        explicit FramePoolScope(FramePool* pool) : m_previous(FramePool::current()) { FramePool::setCurrent(pool); }
+        ~FramePoolScope() { FramePool::setCurrent(m_previous); }
+        FramePoolScope(const FramePoolScope&) = delete;
+        FramePoolScope& operator=(const FramePoolScope&) = delete;
+    private:
+        FramePool* m_previous;
+    };
+}
+
+FramePool::~FramePool() {
+    for (auto& head : m_freeLists) {
+        while (head) {
+            FreeBlock* next = head->next;
+            ::operator delete(head);
+            head = next;
+        }
+    }
+    if (m_liveFrames != 0) {
+        std::cerr << "FramePool destroyed with " << m_liveFrames << " live coroutine frames" << std::endl;
+    }
+}
+void* FramePool::allocateFrame(size_t size) {
+    if (FramePool* pool = current()) {
+        return pool->allocate(size);
+    }
+    auto* header = static_cast<BlockHeader*>(::operator new(sizeof(BlockHeader) + size));
+    header->pool = nullptr;
+    header->sizeClass = SIZE_CLASS_COUNT;
+    return header + 1;
+}
+void FramePool::deallocateFrame(void* ptr) {
+    if (!ptr) return;
+    auto* header = static_cast<BlockHeader*>(ptr) - 1;
+    if (header->pool) {
+        header->pool->release(header);
+    } else {
+        ::operator delete(header);
+    }
+}
+FramePool* FramePool::current() {
+    return t_currentPool;
+}
+void FramePool::setCurrent(FramePool* pool) {
+    t_currentPool = pool;
+}
+void* FramePool::allocate(size_t size) {
+    const size_t total = sizeof(BlockHeader) + size;
+    const size_t sizeClass = (total + SIZE_CLASS_STEP - 1) / SIZE_CLASS_STEP - 1;
+
+    void* block = nullptr;
+    if (sizeClass < SIZE_CLASS_COUNT) {
+        if (FreeBlock* head = m_freeLists[sizeClass]) {
+            m_freeLists[sizeClass] = head->next;
+            --m_pooledFrames;
+            block = head;
+        } else {
+            block = ::operator new((sizeClass + 1) * SIZE_CLASS_STEP);
+        }
+    } else {
+        block = ::operator new(total);
+    }
+
+    auto* header = static_cast<BlockHeader*>(block);
+    header->pool = this;
+    header->sizeClass = std::min(sizeClass, SIZE_CLASS_COUNT);
+    ++m_liveFrames;
+    return header + 1;
+}
+void FramePool::release(BlockHeader* header) {
+    --m_liveFrames;
+    const size_t sizeClass = header->sizeClass;
+    if (sizeClass >= SIZE_CLASS_COUNT) {
+        ::operator delete(header);
+        return;
+    }
+    auto* block = reinterpret_cast<FreeBlock*>(header);
+    block->next = m_freeLists[sizeClass];
+    m_freeLists[sizeClass] = block;
+    ++m_pooledFrames;
+}
+
+void SessionTask::promise_type::unhandled_exception() noexcept {
+    try {
+        throw;
+    } catch (const std::exception& e) {
+        std::cerr << "Session handler threw: " << e.what() << std::endl;
+    } catch (...) {
+        std::cerr << "Session handler threw unknown exception" << std::endl;
+    }
+}
+void* SessionTask::promise_type::operator new(size_t size) {
+    return FramePool::allocateFrame(size);
+}
+void SessionTask::promise_type::operator delete(void* ptr) noexcept {
+    FramePool::deallocateFrame(ptr);
+}
+SessionTask& SessionTask::operator=(SessionTask&& other) noexcept {
+    if (this != &other) {
+        if (m_handle) m_handle.destroy();
+        m_handle = std::exchange(other.m_handle, nullptr);
+    }
+    return *this;
+}
+SessionTask::~SessionTask() {
+    if (m_handle) {
+        m_handle.destroy();
+    }
+}
+
+std::optional<std::string> Session::ReadAwaiter::await_resume() {
+    if (session.m_frames.empty()) {
+        return std::nullopt;
+    }
+    std::string frame = std::move(session.m_frames.front());
+    session.m_frames.pop_front();
+    return frame;
+}
+bool Session::WriteAwaiter::await_ready() noexcept {
+    TCPServer* tcpServer = session.m_manager->m_tcpServer;
+    result = session.m_open && tcpServer->sendData(session.m_fd, data);
+    // The part the socket did not take waits for EPOLLOUT, SessionManager::onDrain resumes the handler
+    return !result || !tcpServer->hasPendingOutput(session.m_fd);
+}
+void Session::SleepAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    session.m_manager->addTimer(&session, handle, delay);
+}
+void Session::close() {
+    if (!m_open) return;
+    // TCPServer calls back into SessionManager::onDisconnect, which detaches this session
+    m_manager->m_tcpServer->disconnectClient(m_fd);
+    m_open = false;
+}
+void Session::appendData(const std::string& data) {
+    m_pending += data;
+    size_t start = 0;
+    size_t pos;
+    while ((pos = m_pending.find('\n', start)) != std::string::npos) {
+        size_t end = pos;
+        if (end > start && m_pending[end - 1] == '\r') {
+            --end;
+        }
+        m_frames.emplace_back(m_pending, start, end - start);
+        start = pos + 1;
+    }
+    m_pending.erase(0, start);
+}
+
+SessionManager::SessionManager(TCPServer* tcpServer, Handler handler) :
+    m_tcpServer(tcpServer),
+    m_handler(std::move(handler)) {
+}
+SessionManager::~SessionManager() {
+    // Destroy suspended frames while the pool is still alive
+    m_timers = {};
+    m_sessions.clear();
+    m_detached.clear();
+}
+void SessionManager::onConnect(int client_fd) {
+    auto session = std::make_unique<Session>(this, client_fd);
+    Session* raw = session.get();
+    {
+        FramePoolScope scope(&m_framePool);
+        session->m_task = m_handler(*raw);
+    }
+    if (!session->m_task.isValid()) {
+        std::cerr << "Session handler returned no coroutine for client " << client_fd << std::endl;
+        return;
+    }
+    m_sessions[client_fd] = std::move(session);
+    resume(raw, nullptr);
+}
+void SessionManager::onData(int client_fd, const std::string& data) {
+    auto it = m_sessions.find(client_fd);
+    if (it == m_sessions.end()) {
+        return;
+    }
+    Session* session = it->second.get();
+    session->appendData(data);
+    if (session->m_waiting && !session->m_frames.empty()) {
+        resume(session, std::exchange(session->m_waiting, nullptr));
+    }
+}
+void SessionManager::onDisconnect(int client_fd) {
+    auto it = m_sessions.find(client_fd);
+    if (it == m_sessions.end()) {
+        return;
+    }
+    Session* session = it->second.get();
+    session->m_open = false;
+    m_detached.push_back(std::move(it->second));
+    m_sessions.erase(it);
+
+    // A handler blocked in read() wakes up with std::nullopt, one blocked in write() with false
+    if (session->m_waiting) {
+        resume(session, std::exchange(session->m_waiting, nullptr));
+    } else if (session->m_writeWaiting) {
+        resume(session, std::exchange(session->m_writeWaiting, nullptr));
+    }
+}
+void SessionManager::onDrain(int client_fd) {
+    auto it = m_sessions.find(client_fd);
+    if (it == m_sessions.end()) {
+        return;
+    }
+    Session* session = it->second.get();
+    if (session->m_writeWaiting) {
+        resume(session, std::exchange(session->m_writeWaiting, nullptr));
+    }
+}
+void SessionManager::runTimers() {
+    const auto now = Clock::now();
+    while (!m_timers.empty() && m_timers.top().deadline <= now) {
+        Timer timer = m_timers.top();
+        m_timers.pop();
+        resume(timer.session, timer.handle);
+    }
+}
+int SessionManager::nextTimeout(int defaultTimeoutMs) const {
+    if (m_timers.empty()) {
+        return defaultTimeoutMs;
+    }
+    auto left = std::chrono::ceil<std::chrono::milliseconds>(m_timers.top().deadline - Clock::now());
+    if (left.count() <= 0) {
+        return 0;
+    }
+    return static_cast<int>(std::min<long long>(left.count(), defaultTimeoutMs));
+}
+void SessionManager::addTimer(Session* session, std::coroutine_handle<> handle, std::chrono::milliseconds delay) {
+    m_timers.push(Timer{Clock::now() + delay, m_timerSequence++, session, handle});
+}
+void SessionManager::resume(Session* session, std::coroutine_handle<> handle) {
+    {
+        FramePoolScope scope(&m_framePool);
+        if (handle) {
+            handle.resume();
+        } else {
+            session->m_task.resume();
+        }
+    }
+    // Handler returned: the session is over, close the connection
+    if (session->m_task.isDone() && session->m_open) {
+        session->close();
+    }
+    reapFinished();
+}
+void SessionManager::reapFinished() {
+    std::erase_if(m_detached, [](const std::unique_ptr<Session>& session) {
+        return session->m_task.isDone();
+    });
+}
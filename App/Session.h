@@ -0,0 +1,219 @@
+//
+// Created by roach on 19.11.2025.
+//
+
+#ifndef ASYNCSERVER_SESSION_H
+#define ASYNCSERVER_SESSION_H
+
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class TCPServer;
+class SessionManager;
+
+// Free-list allocator for coroutine frames. One pool per reactor; frames of the
+// same size class are recycled instead of going back to the heap on every session.
+class FramePool {
+public:
+    FramePool() = default;
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+    ~FramePool();
+
+    // Frames go to the current() pool, or straight to the heap when none is set
+    static void* allocateFrame(size_t size);
+    static void deallocateFrame(void* ptr);
+
+    size_t getLiveFrames() const { return m_liveFrames; }
+    size_t getPooledFrames() const { return m_pooledFrames; }
+
+    // Pool used by coroutine frames created on the current thread (nullptr -> heap)
+    static FramePool* current();
+    static void setCurrent(FramePool* pool);
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+    // Every block starts with a header so deallocate() finds its pool and size class
+    struct alignas(std::max_align_t) BlockHeader {
+        FramePool* pool;
+        size_t sizeClass;
+    };
+
+    static constexpr size_t SIZE_CLASS_STEP = 64;
+    static constexpr size_t SIZE_CLASS_COUNT = 32;  // frames up to 2 KiB are pooled
+
+    void* allocate(size_t size);
+    void release(BlockHeader* header);
+
+    FreeBlock* m_freeLists[SIZE_CLASS_COUNT] = {};
+    size_t m_liveFrames = 0;
+    size_t m_pooledFrames = 0;
+};
+
+// Return type of a connection handler coroutine
+class SessionTask {
+public:
+    struct promise_type {
+        SessionTask get_return_object() {
+            return SessionTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept;
+
+        static void* operator new(size_t size);
+        static void operator delete(void* ptr) noexcept;
+    };
+
+    SessionTask() = default;
+    explicit SessionTask(std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+    SessionTask(const SessionTask&) = delete;
+    SessionTask& operator=(const SessionTask&) = delete;
+    SessionTask(SessionTask&& other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {}
+    SessionTask& operator=(SessionTask&& other) noexcept;
+    ~SessionTask();
+
+    bool isValid() const { return static_cast<bool>(m_handle); }
+    bool isDone() const { return !m_handle || m_handle.done(); }
+    void resume() const { m_handle.resume(); }
+
+private:
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+// State of one TCP connection driven by a handler coroutine.
+// All awaitables complete on the reactor thread.
+class Session {
+public:
+    // co_await session.read() -> next '\n'-terminated frame, std::nullopt once the peer is gone
+    struct ReadAwaiter {
+        Session& session;
+        bool await_ready() const noexcept { return !session.m_frames.empty() || !session.m_open; }
+        void await_suspend(std::coroutine_handle<> handle) noexcept { session.m_waiting = handle; }
+        std::optional<std::string> await_resume();
+    };
+
+    // co_await session.write(data) -> true once the socket has taken the data. When it has to be
+    // queued the handler waits for the queue to drain, so it cannot outrun a slow reader.
+    // false when the connection failed or was closed first
+    struct WriteAwaiter {
+        Session& session;
+        std::string data;
+        bool result = false;
+        bool await_ready() noexcept;
+        void await_suspend(std::coroutine_handle<> handle) noexcept { session.m_writeWaiting = handle; }
+        bool await_resume() const noexcept { return result && session.m_open; }
+    };
+
+    // co_await session.sleep(ms) -> resumes from the reactor after the delay
+    struct SleepAwaiter {
+        Session& session;
+        std::chrono::milliseconds delay;
+        bool await_ready() const noexcept { return delay.count() <= 0; }
+        void await_suspend(std::coroutine_handle<> handle);
+        void await_resume() const noexcept {}
+    };
+
+    Session(SessionManager* manager, int client_fd) : m_manager(manager), m_fd(client_fd) {}
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+
+    ReadAwaiter read() { return ReadAwaiter{*this}; }
+    WriteAwaiter write(std::string data) { return WriteAwaiter{*this, std::move(data)}; }
+    SleepAwaiter sleep(std::chrono::milliseconds delay) { return SleepAwaiter{*this, delay}; }
+    void close();
+
+    int getFD() const { return m_fd; }
+    bool isOpen() const { return m_open; }
+
+private:
+    friend class SessionManager;
+
+    void appendData(const std::string& data);
+
+    SessionManager* m_manager;
+    int m_fd;
+    bool m_open = true;
+    std::string m_pending;             // bytes after the last '\n'
+    std::deque<std::string> m_frames;  // complete frames not yet read by the handler
+    std::coroutine_handle<> m_waiting; // handler suspended in read()
+    std::coroutine_handle<> m_writeWaiting; // handler suspended in write() until the output drains
+    SessionTask m_task;
+};
+
+// Runs one handler coroutine per TCP connection on top of the TCPServer callbacks.
+//
+// Пример использования:
+//     server.setSessionHandler([](Session& s) -> SessionTask {
+//         while (auto frame = co_await s.read()) {
+//             co_await s.sleep(std::chrono::milliseconds(10));
+//             co_await s.write("echo: " + *frame);
+//         }
+//     });
+class SessionManager {
+public:
+    using Handler = std::function<SessionTask(Session& session)>;
+
+    SessionManager(TCPServer* tcpServer, Handler handler);
+    SessionManager(const SessionManager&) = delete;
+    SessionManager& operator=(const SessionManager&) = delete;
+    ~SessionManager();
+
+    void onConnect(int client_fd);
+    void onData(int client_fd, const std::string& data);
+    void onDisconnect(int client_fd);
+    // The client's output queue is empty again, a handler waiting in write() goes on
+    void onDrain(int client_fd);
+
+    // Resumes handlers whose sleep() expired
+    void runTimers();
+    // epoll timeout that does not overshoot the nearest timer
+    int nextTimeout(int defaultTimeoutMs) const;
+
+    size_t getSessionCount() const { return m_sessions.size(); }
+    const FramePool& getFramePool() const { return m_framePool; }
+
+private:
+    friend class Session;
+    using Clock = std::chrono::steady_clock;
+
+    struct Timer {
+        Clock::time_point deadline;
+        uint64_t sequence;
+        Session* session;
+        std::coroutine_handle<> handle;
+        bool operator>(const Timer& other) const {
+            return deadline != other.deadline ? deadline > other.deadline : sequence > other.sequence;
+        }
+    };
+
+    void addTimer(Session* session, std::coroutine_handle<> handle, std::chrono::milliseconds delay);
+    void resume(Session* session, std::coroutine_handle<> handle);
+    void reapFinished();
+
+    // Frame pool must outlive every session holding a frame
+    FramePool m_framePool;
+    TCPServer* m_tcpServer;
+    Handler m_handler;
+    std::unordered_map<int, std::unique_ptr<Session>> m_sessions;
+    std::vector<std::unique_ptr<Session>> m_detached;  // disconnected, handler still suspended
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<>> m_timers;
+    uint64_t m_timerSequence = 0;
+};
+
+
+#endif //ASYNCSERVER_SESSION_H
@@ -0,0 +1,165 @@
+//
+// Created by roach on 19.11.2025.
+//
+
+#include "StatsSegment.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+StatsSnapshot makeStatsSnapshot(const ServerStats &stats) {
+    StatsSnapshot snapshot{};
+    snapshot.publishedNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    snapshot.totalClients = stats.getTotalClients();
+    snapshot.currentClients = stats.getCurrentClients();
+
+    KeyValueStats kv = stats.getKeyValueStats();
+    snapshot.kvKeys = kv.keys;
+    snapshot.kvMemoryUsed = kv.memoryUsed;
+    snapshot.kvMemoryLimit = kv.memoryLimit;
+    snapshot.kvHits = kv.hits;
+    snapshot.kvMisses = kv.misses;
+    snapshot.kvEvictions = kv.evictions;
+    snapshot.kvExpired = kv.expired;
+
+    snapshot.udpQueueDepth = stats.getUdpQueueDepth();
+    snapshot.udpDeferred = stats.getUdpDeferred();
+    snapshot.udpDropped = stats.getUdpDropped();
+
+    const LoopStats& loop = stats.getLoopStats();
+    snapshot.loopIterations = loop.getIterations();
+    snapshot.loopWakeups = loop.getWakeups();
+    snapshot.loopEvents = loop.getEvents();
+    snapshot.loopIdleNs = loop.getIdleNs();
+    snapshot.loopBusyNs = loop.getBusyNs();
+    snapshot.loopMaxLagNs = loop.getMaxLagNs();
+    snapshot.slowCallbacks = loop.getSlowCallbacks();
+    for (size_t i = 0; i < LoopStats::HANDLER_COUNT; ++i) {
+        LoopStats::HandlerTotals totals = loop.getHandler(static_cast<LoopHandler>(i));
+        snapshot.handlerCalls[i] = totals.calls;
+        snapshot.handlerTotalNs[i] = totals.totalNs;
+        snapshot.handlerMaxNs[i] = totals.maxNs;
+    }
+    return snapshot;
+}
+
+StatsPublisher::~StatsPublisher() {
+    close();
+}
+bool StatsPublisher::open(const std::string &name) {
+    close();
+    int fd = ::shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd == -1) {
+        std::cerr << "shm_open(" << name << ") failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+    if (::ftruncate(fd, sizeof(StatsSegmentLayout)) == -1) {
+        std::cerr << "ftruncate of stats segment failed: " << strerror(errno) << std::endl;
+        ::close(fd);
+        ::shm_unlink(name.c_str());
+        return false;
+    }
+    void* memory = ::mmap(nullptr, sizeof(StatsSegmentLayout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+        std::cerr << "mmap of stats segment failed: " << strerror(errno) << std::endl;
+        ::shm_unlink(name.c_str());
+        return false;
+    }
+
+    m_segment = static_cast<StatsSegmentLayout*>(memory);
+    m_segment->magic = 0;
+    m_segment->sequence.store(0, std::memory_order_relaxed);
+    m_segment->snapshot = StatsSnapshot{};
+    m_segment->version = STATS_SEGMENT_VERSION;
+    m_segment->snapshotSize = sizeof(StatsSnapshot);
+    m_segment->pid = ::getpid();
+    // Readers check the magic last, so a half-initialized header is never accepted
+    std::atomic_thread_fence(std::memory_order_release);
+    m_segment->magic = STATS_SEGMENT_MAGIC;
+    m_name = name;
+    std::cout << "Publishing stats to shared memory " << name << std::endl;
+    return true;
+}
+void StatsPublisher::close() {
+    if (!m_segment) {
+        return;
+    }
+    ::munmap(m_segment, sizeof(StatsSegmentLayout));
+    ::shm_unlink(m_name.c_str());
+    m_segment = nullptr;
+    m_name.clear();
+}
+void StatsPublisher::publish(const ServerStats &stats) {
+    if (!m_segment) {
+        return;
+    }
+    StatsSnapshot snapshot = makeStatsSnapshot(stats);
+    uint64_t sequence = m_segment->sequence.load(std::memory_order_relaxed);
+    m_segment->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(&m_segment->snapshot, &snapshot, sizeof(snapshot));
+    m_segment->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+StatsSegmentReader::~StatsSegmentReader() {
+    if (m_segment) {
+        ::munmap(const_cast<StatsSegmentLayout*>(m_segment), sizeof(StatsSegmentLayout));
+    }
+}
+bool StatsSegmentReader::open(const std::string &name) {
+    int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd == -1) {
+        std::cerr << "shm_open(" << name << ") failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+    struct stat info{};
+    if (::fstat(fd, &info) == -1 || static_cast<size_t>(info.st_size) < sizeof(StatsSegmentLayout)) {
+        std::cerr << "Stats segment " << name << " is too small" << std::endl;
+        ::close(fd);
+        return false;
+    }
+    void* memory = ::mmap(nullptr, sizeof(StatsSegmentLayout), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+        std::cerr << "mmap of stats segment failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    const auto* segment = static_cast<const StatsSegmentLayout*>(memory);
+    if (segment->magic != STATS_SEGMENT_MAGIC || segment->version != STATS_SEGMENT_VERSION
+        || segment->snapshotSize != sizeof(StatsSnapshot)) {
+        std::cerr << "Stats segment " << name << " has version " << segment->version
+                  << ", this reader understands " << STATS_SEGMENT_VERSION << std::endl;
+        ::munmap(memory, sizeof(StatsSegmentLayout));
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    m_segment = segment;
+    return true;
+}
+bool StatsSegmentReader::read(StatsSnapshot &out) const {
+    constexpr int MAX_ATTEMPTS = 1000;
+    if (!m_segment) {
+        return false;
+    }
+    for (int attempt = 0; attempt < MAX_ATTEMPTS; ++attempt) {
+        uint64_t before = m_segment->sequence.load(std::memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+        std::memcpy(&out, &m_segment->snapshot, sizeof(out));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_segment->sequence.load(std::memory_order_relaxed) == before) {
+            return true;
+        }
+    }
+    return false;
+}
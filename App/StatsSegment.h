@@ -0,0 +1,98 @@
+//
+// Created by roach on 19.11.2025.
+//
+
+#ifndef ASYNCSERVER_STATSSEGMENT_H
+#define ASYNCSERVER_STATSSEGMENT_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "ServerStats.h"
+
+// Plain copy of ServerStats laid out for the shared segment. Bump STATS_SEGMENT_VERSION
+// whenever fields are added, removed or reordered.
+struct StatsSnapshot {
+    uint64_t publishedNs;  // steady_clock (CLOCK_MONOTONIC) time of the snapshot
+    uint64_t totalClients;
+    uint64_t currentClients;
+
+    uint64_t kvKeys;
+    uint64_t kvMemoryUsed;
+    uint64_t kvMemoryLimit;
+    uint64_t kvHits;
+    uint64_t kvMisses;
+    uint64_t kvEvictions;
+    uint64_t kvExpired;
+
+    uint64_t udpQueueDepth;
+    uint64_t udpDeferred;
+    uint64_t udpDropped;
+
+    uint64_t loopIterations;
+    uint64_t loopWakeups;
+    uint64_t loopEvents;
+    uint64_t loopIdleNs;
+    uint64_t loopBusyNs;
+    uint64_t loopMaxLagNs;
+    uint64_t slowCallbacks;
+    uint64_t handlerCalls[LoopStats::HANDLER_COUNT];
+    uint64_t handlerTotalNs[LoopStats::HANDLER_COUNT];
+    uint64_t handlerMaxNs[LoopStats::HANDLER_COUNT];
+};
+
+constexpr uint32_t STATS_SEGMENT_MAGIC = 0x41535354;  // "ASST"
+constexpr uint32_t STATS_SEGMENT_VERSION = 3;
+
+// Layout of the POSIX shared memory object. The snapshot is guarded by a seqlock:
+// odd sequence - the server is writing, readers retry.
+struct StatsSegmentLayout {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t snapshotSize;
+    int32_t pid;
+    std::atomic<uint64_t> sequence;
+    StatsSnapshot snapshot;
+};
+
+StatsSnapshot makeStatsSnapshot(const ServerStats& stats);
+
+// Server side: owns the segment and unlinks it on close
+class StatsPublisher {
+public:
+    StatsPublisher() = default;
+    StatsPublisher(const StatsPublisher&) = delete;
+    StatsPublisher& operator=(const StatsPublisher&) = delete;
+    ~StatsPublisher();
+
+    // name is a shm_open name such as "/async-server-stats"
+    bool open(const std::string& name);
+    void close();
+    bool isOpen() const { return m_segment != nullptr; }
+    void publish(const ServerStats& stats);
+
+private:
+    StatsSegmentLayout* m_segment = nullptr;
+    std::string m_name;
+};
+
+// Monitoring side: maps the segment read-only, never touches the server
+class StatsSegmentReader {
+public:
+    StatsSegmentReader() = default;
+    StatsSegmentReader(const StatsSegmentReader&) = delete;
+    StatsSegmentReader& operator=(const StatsSegmentReader&) = delete;
+    ~StatsSegmentReader();
+
+    bool open(const std::string& name);
+    // false when no consistent copy could be taken (server keeps writing or is gone)
+    bool read(StatsSnapshot& out) const;
+    int getPid() const { return m_segment ? m_segment->pid : -1; }
+
+private:
+    const StatsSegmentLayout* m_segment = nullptr;
+};
+
+
+#endif //ASYNCSERVER_STATSSEGMENT_H
@@ -0,0 +1,93 @@
+//
+// Created by roach on 19.11.2025.
+//
+
+#ifndef ASYNCSERVER_TASKQUEUE_H
+#define ASYNCSERVER_TASKQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+
+// Lock-free multi-producer single-consumer queue of closures (Vyukov's intrusive list).
+// Any thread may push; only the reactor that owns the queue pops.
+class TaskQueue {
+public:
+    using Task = std::function<void()>;
+
+    TaskQueue() : m_head(&m_stub), m_tail(&m_stub) {}
+    TaskQueue(const TaskQueue&) = delete;
+    TaskQueue& operator=(const TaskQueue&) = delete;
+    ~TaskQueue() {
+        while (Node* node = pop()) {
+            delete node;
+        }
+    }
+
+    void push(Task task) {
+        pushNode(new Node(std::move(task)));
+    }
+
+    // Runs up to maxTasks queued tasks; true when more are left
+    bool runPending(size_t maxTasks) {
+        for (size_t done = 0; done < maxTasks; ++done) {
+            Node* node = pop();
+            if (!node) {
+                return false;
+            }
+            node->task();
+            delete node;
+        }
+        return m_tail->next.load(std::memory_order_acquire) != nullptr || m_tail != &m_stub;
+    }
+
+private:
+    struct Node {
+        Node() = default;
+        explicit Node(Task task) : task(std::move(task)) {}
+        std::atomic<Node*> next{nullptr};
+        Task task;
+    };
+
+    void pushNode(Node* node) {
+        node->next.store(nullptr, std::memory_order_relaxed);
+        // One atomic exchange per producer, the link is published afterwards
+        Node* prev = m_head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    Node* pop() {
+        Node* tail = m_tail;
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (tail == &m_stub) {
+            if (!next) {
+                return nullptr;
+            }
+            m_tail = next;
+            tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (next) {
+            m_tail = next;
+            return tail;
+        }
+        if (tail != m_head.load(std::memory_order_acquire)) {
+            // A producer swapped the head but has not linked its node yet
+            return nullptr;
+        }
+        pushNode(&m_stub);
+        next = tail->next.load(std::memory_order_acquire);
+        if (next) {
+            m_tail = next;
+            return tail;
+        }
+        return nullptr;
+    }
+
+    std::atomic<Node*> m_head;  // producers
+    Node* m_tail;               // consumer
+    Node m_stub;
+};
+
+
+#endif //ASYNCSERVER_TASKQUEUE_H
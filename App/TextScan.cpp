@@ -0,0 +1,170 @@
+//
+// Created by roach on 19.11.2025.
+//
+
+#include "TextScan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ASYNCSERVER_SCAN_X86 1
+#endif
+
+namespace {
+    bool isSpace(char c) {
+        return c == '\n' || c == '\r' || c == ' ' || c == '\t';
+    }
+
+    size_t findScalar(const char* data, size_t size, char byte) {
+        for (size_t i = 0; i < size; ++i) {
+            if (data[i] == byte) {
+                return i;
+            }
+        }
+        return size;
+    }
+    size_t trimmedLengthScalar(const char* data, size_t size) {
+        while (size > 0 && isSpace(data[size - 1])) {
+            --size;
+        }
+        return size;
+    }
+
+#ifdef ASYNCSERVER_SCAN_X86
+    // SSE2 is part of x86-64, so this kernel needs no target attribute
+    size_t findSse2(const char* data, size_t size, char byte) {
+        const __m128i needle = _mm_set1_epi8(byte);
+        size_t i = 0;
+        for (; i + 16 <= size; i += 16) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle)));
+            if (mask != 0) {
+                return i + __builtin_ctz(mask);
+            }
+        }
+        return i + findScalar(data + i, size - i, byte);
+    }
+    size_t trimmedLengthSse2(const char* data, size_t size) {
+        const __m128i newline = _mm_set1_epi8('\n');
+        const __m128i carriage = _mm_set1_epi8('\r');
+        const __m128i space = _mm_set1_epi8(' ');
+        const __m128i tab = _mm_set1_epi8('\t');
+        // Walk back 16 bytes at a time until a block has a non-space byte
+        while (size >= 16) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + size - 16));
+            __m128i spaces = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, newline), _mm_cmpeq_epi8(chunk, carriage)),
+                                          _mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, tab)));
+            unsigned text = ~static_cast<unsigned>(_mm_movemask_epi8(spaces)) & 0xFFFFu;
+            if (text != 0) {
+                return size - 16 + (31 - __builtin_clz(text)) + 1;
+            }
+            size -= 16;
+        }
+        return trimmedLengthScalar(data, size);
+    }
+
+    __attribute__((target("avx2")))
+    size_t findAvx2(const char* data, size_t size, char byte) {
+        const __m256i needle = _mm256_set1_epi8(byte);
+        size_t i = 0;
+        for (; i + 32 <= size; i += 32) {
+            __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle)));
+            if (mask != 0) {
+                return i + __builtin_ctz(mask);
+            }
+        }
+        // Tail stays in this function: calling the SSE2 kernel would mix legacy SSE with dirty AVX state
+        if (i + 16 <= size) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm256_castsi256_si128(needle))));
+            if (mask != 0) {
+                return i + __builtin_ctz(mask);
+            }
+            i += 16;
+        }
+        return i + findScalar(data + i, size - i, byte);
+    }
+    __attribute__((target("avx2")))
+    size_t trimmedLengthAvx2(const char* data, size_t size) {
+        const __m256i newline = _mm256_set1_epi8('\n');
+        const __m256i carriage = _mm256_set1_epi8('\r');
+        const __m256i space = _mm256_set1_epi8(' ');
+        const __m256i tab = _mm256_set1_epi8('\t');
+        while (size >= 32) {
+            __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + size - 32));
+            __m256i spaces = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_cmpeq_epi8(chunk, newline), _mm256_cmpeq_epi8(chunk, carriage)),
+                    _mm256_or_si256(_mm256_cmpeq_epi8(chunk, space), _mm256_cmpeq_epi8(chunk, tab)));
+            unsigned text = ~static_cast<unsigned>(_mm256_movemask_epi8(spaces));
+            if (text != 0) {
+                return size - 32 + (31 - __builtin_clz(text)) + 1;
+            }
+            size -= 32;
+        }
+        if (size >= 16) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + size - 16));
+            __m128i spaces = _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm256_castsi256_si128(newline)),
+                                 _mm_cmpeq_epi8(chunk, _mm256_castsi256_si128(carriage))),
+                    _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm256_castsi256_si128(space)),
+                                 _mm_cmpeq_epi8(chunk, _mm256_castsi256_si128(tab))));
+            unsigned text = ~static_cast<unsigned>(_mm_movemask_epi8(spaces)) & 0xFFFFu;
+            if (text != 0) {
+                return size - 16 + (31 - __builtin_clz(text)) + 1;
+            }
+            size -= 16;
+        }
+        return trimmedLengthScalar(data, size);
+    }
+#endif
+}
+
+TextScan::Kernels TextScan::s_kernels = TextScan::detect();
+
+const char* TextScan::kernelName(Kernel kernel) {
+    switch (kernel) {
+        case Kernel::Scalar: return "scalar";
+        case Kernel::Sse2: return "sse2";
+        case Kernel::Avx2: return "avx2";
+        default: return "unknown";
+    }
+}
+bool TextScan::isSupported(Kernel kernel) {
+#ifdef ASYNCSERVER_SCAN_X86
+    __builtin_cpu_init();
+    switch (kernel) {
+        case Kernel::Scalar: return true;
+        case Kernel::Sse2: return __builtin_cpu_supports("sse2");
+        case Kernel::Avx2: return __builtin_cpu_supports("avx2");
+    }
+    return false;
+#else
+    return kernel == Kernel::Scalar;
+#endif
+}
+bool TextScan::useKernel(Kernel kernel) {
+    if (!isSupported(kernel)) {
+        return false;
+    }
+    s_kernels = kernelsFor(kernel);
+    return true;
+}
+TextScan::Kernels TextScan::kernelsFor(Kernel kernel) {
+#ifdef ASYNCSERVER_SCAN_X86
+    if (kernel == Kernel::Avx2) {
+        return {Kernel::Avx2, findAvx2, trimmedLengthAvx2};
+    }
+    if (kernel == Kernel::Sse2) {
+        return {Kernel::Sse2, findSse2, trimmedLengthSse2};
+    }
+#endif
+    return {Kernel::Scalar, findScalar, trimmedLengthScalar};
+}
+TextScan::Kernels TextScan::detect() {
+    for (Kernel kernel : {Kernel::Avx2, Kernel::Sse2}) {
+        if (isSupported(kernel)) {
+            return kernelsFor(kernel);
+        }
+    }
+    return kernelsFor(Kernel::Scalar);
+}
@@ -0,0 +1,52 @@
+//
+// Created by roach on 19.11.2025.
+//
+
+#ifndef ASYNCSERVER_TEXTSCAN_H
+#define ASYNCSERVER_TEXTSCAN_H
+
+#include <cstddef>
+#include <string_view>
+
+// Scanning kernels for the receive path: frame delimiters, trailing whitespace and
+// command detection. The widest kernel the CPU supports is picked once at startup.
+class TextScan {
+public:
+    enum class Kernel {
+        Scalar,
+        Sse2,
+        Avx2
+    };
+
+    // Position of the first `byte`, npos when there is none
+    static size_t find(std::string_view data, char byte) {
+        size_t pos = s_kernels.find(data.data(), data.size(), byte);
+        return pos == data.size() ? std::string_view::npos : pos;
+    }
+    // Drops trailing '\n', '\r', ' ' and '\t' without copying
+    static std::string_view trimRight(std::string_view data) {
+        return data.substr(0, s_kernels.trimmedLength(data.data(), data.size()));
+    }
+    static bool isCommand(std::string_view frame) { return !frame.empty() && frame.front() == '/'; }
+
+    static Kernel getKernel() { return s_kernels.kernel; }
+    static const char* kernelName(Kernel kernel);
+    static bool isSupported(Kernel kernel);
+    // For benchmarks and tests; false when the CPU lacks the instructions
+    static bool useKernel(Kernel kernel);
+
+private:
+    struct Kernels {
+        Kernel kernel;
+        size_t (*find)(const char* data, size_t size, char byte);
+        size_t (*trimmedLength)(const char* data, size_t size);
+    };
+
+    static Kernels kernelsFor(Kernel kernel);
+    static Kernels detect();
+
+    static Kernels s_kernels;
+};
+
+
+#endif //ASYNCSERVER_TEXTSCAN_H
@@ -0,0 +1,102 @@
+//
+// Created by roach on 19.11.2025.
+//
+
+#include "Tracer.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <unistd.h>
+
+namespace {
+    // Rings outlive their threads so a dump still shows what finished threads did
+    std::mutex g_buffersMutex;
+    std::vector<std::unique_ptr<TraceBuffer>> g_buffers;
+}
+
+const char* traceStageName(TraceStage stage) {
+    switch (stage) {
+        case TraceStage::Request: return "request";
+        case TraceStage::TcpRecv: return "tcp-recv";
+        case TraceStage::UdpRecv: return "udp-recv";
+        case TraceStage::Parse: return "parse";
+        case TraceStage::Process: return "process";
+        case TraceStage::TcpSend: return "tcp-send";
+        case TraceStage::UdpSend: return "udp-send";
+        default: return "unknown";
+    }
+}
+
+void TraceBuffer::snapshot(std::vector<TraceEvent> &out) const {
+    uint64_t head = m_head.load(std::memory_order_acquire);
+    uint64_t first = head > CAPACITY ? head - CAPACITY : 0;
+    size_t start = out.size();
+    for (uint64_t i = first; i < head; ++i) {
+        out.push_back(m_events[i & (CAPACITY - 1)]);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    // Slots the writer reused during the copy hold newer events than their index says
+    // (the slot of index `after` may be half written)
+    uint64_t after = m_head.load(std::memory_order_relaxed) + 1;
+    if (after > first + CAPACITY) {
+        size_t overwritten = std::min<uint64_t>(after - first - CAPACITY, head - first);
+        out.erase(out.begin() + static_cast<std::ptrdiff_t>(start),
+                  out.begin() + static_cast<std::ptrdiff_t>(start + overwritten));
+    }
+}
+
+void Tracer::record(TraceStage stage, int fd, Clock::time_point started, Clock::time_point finished) {
+    TraceEvent event;
+    event.requestId = t_requestId;
+    event.startNs = std::chrono::duration_cast<std::chrono::nanoseconds>(started.time_since_epoch()).count();
+    event.durationNs = std::chrono::duration_cast<std::chrono::nanoseconds>(finished - started).count();
+    event.fd = fd;
+    event.stage = stage;
+    localBuffer().push(event);
+}
+TraceBuffer& Tracer::localBuffer() {
+    if (!t_buffer) {
+        auto buffer = std::make_unique<TraceBuffer>(static_cast<uint32_t>(::gettid()));
+        t_buffer = buffer.get();
+        std::lock_guard<std::mutex> lock(g_buffersMutex);
+        g_buffers.push_back(std::move(buffer));
+    }
+    return *t_buffer;
+}
+bool Tracer::dumpChromeTrace(const std::string &path, size_t &eventCount) {
+    std::ofstream out(path, std::ios::trunc);
+    if (!out) {
+        std::cerr << "Cannot open trace file " << path << std::endl;
+        return false;
+    }
+
+    const pid_t pid = ::getpid();
+    std::vector<TraceEvent> events;
+    eventCount = 0;
+    bool first = true;
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    out << std::fixed << std::setprecision(3);
+
+    std::lock_guard<std::mutex> lock(g_buffersMutex);
+    for (const auto& buffer : g_buffers) {
+        events.clear();
+        buffer->snapshot(events);
+        for (const auto& event : events) {
+            // Chrome trace timestamps are microseconds
+            out << (first ? "\n" : ",\n")
+                << "{\"name\":\"" << traceStageName(event.stage) << "\",\"ph\":\"X\""
+                << ",\"ts\":" << event.startNs / 1000.0 << ",\"dur\":" << event.durationNs / 1000.0
+                << ",\"pid\":" << pid << ",\"tid\":" << buffer->getThreadId()
+                << ",\"args\":{\"request\":" << event.requestId << ",\"fd\":" << event.fd << "}}";
+            first = false;
+            ++eventCount;
+        }
+    }
+    out << "\n]}\n";
+    return static_cast<bool>(out);
+}
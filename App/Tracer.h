@@ -0,0 +1,157 @@
+//
+// Created by roach on 19.11.2025.
+//
+
+#ifndef ASYNCSERVER_TRACER_H
+#define ASYNCSERVER_TRACER_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Stages of a request as they show up in the trace viewer
+enum class TraceStage : uint8_t {
+    Request,
+    TcpRecv,
+    UdpRecv,
+    Parse,
+    Process,
+    TcpSend,
+    UdpSend,
+    Count
+};
+
+const char* traceStageName(TraceStage stage);
+
+struct TraceEvent {
+    uint64_t requestId;
+    int64_t startNs;
+    int64_t durationNs;
+    int32_t fd;
+    TraceStage stage;
+};
+
+// Ring of the latest spans of one thread. Only the owning thread writes; a dump from
+// another thread copies the slots and drops the ones overwritten while it was copying.
+class TraceBuffer {
+public:
+    static constexpr size_t CAPACITY = 16384;
+
+    explicit TraceBuffer(uint32_t threadId) : m_threadId(threadId) {}
+
+    void push(const TraceEvent& event) {
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        m_events[head & (CAPACITY - 1)] = event;
+        m_head.store(head + 1, std::memory_order_release);
+    }
+    void snapshot(std::vector<TraceEvent>& out) const;
+    uint32_t getThreadId() const { return m_threadId; }
+
+private:
+    std::array<TraceEvent, CAPACITY> m_events{};
+    std::atomic<uint64_t> m_head{0};
+    uint32_t m_threadId;
+};
+
+// Sampled per-request tracing. Every N-th read that returned data starts a traced request and the
+// spans recorded until it ends go to the thread's ring buffer. With sampling off a span
+// costs one thread-local load.
+class Tracer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Trace one of every `every` reads with data, 0 - tracing off
+    static void setSampleEvery(uint32_t every) { s_sampleEvery.store(every, std::memory_order_relaxed); }
+    static uint32_t getSampleEvery() { return s_sampleEvery.load(std::memory_order_relaxed); }
+
+    static bool beginRequest() {
+        uint32_t every = s_sampleEvery.load(std::memory_order_relaxed);
+        if (every == 0 || ++t_sampleCounter < every) {
+            return false;
+        }
+        t_sampleCounter = 0;
+        t_requestId = s_nextRequestId.fetch_add(1, std::memory_order_relaxed) + 1;
+        return true;
+    }
+    static void endRequest() { t_requestId = 0; }
+    static bool active() { return t_requestId != 0; }
+    static void record(TraceStage stage, int fd, Clock::time_point started, Clock::time_point finished);
+
+    // Chrome/Perfetto JSON ("X" complete events) of everything still in the rings
+    static bool dumpChromeTrace(const std::string& path, size_t& eventCount);
+
+    // Async-signal-safe: the reactor starts a dump to DEFAULT_DUMP_PATH on its next iteration
+    static void requestDump() { s_dumpRequested.store(true, std::memory_order_relaxed); }
+    static bool takeDumpRequest() { return s_dumpRequested.exchange(false, std::memory_order_relaxed); }
+
+    static constexpr const char* DEFAULT_DUMP_PATH = "/tmp/async-server-trace.json";
+
+private:
+    static TraceBuffer& localBuffer();
+
+    static inline std::atomic<uint32_t> s_sampleEvery{0};
+    static inline std::atomic<uint64_t> s_nextRequestId{0};
+    static inline std::atomic<bool> s_dumpRequested{false};
+    static inline thread_local uint32_t t_sampleCounter = 0;
+    static inline thread_local uint64_t t_requestId = 0;
+    static inline thread_local TraceBuffer* t_buffer = nullptr;
+};
+
+// Span around a piece of work inside a traced request
+class TraceSpan {
+public:
+    TraceSpan(TraceStage stage, int fd) : m_stage(stage), m_fd(fd) {
+        if (Tracer::active()) {
+            m_started = Tracer::Clock::now();
+        }
+    }
+    ~TraceSpan() {
+        if (m_started != Tracer::Clock::time_point{} && Tracer::active()) {
+            Tracer::record(m_stage, m_fd, m_started, Tracer::Clock::now());
+        }
+    }
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    TraceStage m_stage;
+    int m_fd;
+    Tracer::Clock::time_point m_started{};
+};
+
+// One read and everything done for it. The sampling decision is made in received(), so the
+// EAGAIN/EOF read that ends every drain neither uses up a sample nor leaves anything in the trace.
+class TraceRequest {
+public:
+    TraceRequest() {
+        // The receive span starts before the read, whether it gets sampled is known only after
+        if (Tracer::getSampleEvery() != 0) {
+            m_started = Tracer::Clock::now();
+        }
+    }
+    ~TraceRequest() {
+        if (m_fd != -1) {
+            Tracer::record(TraceStage::Request, m_fd, m_started, Tracer::Clock::now());
+            Tracer::endRequest();
+        }
+    }
+    // Call only for reads that returned data
+    void received(TraceStage stage, int fd) {
+        if (m_started != Tracer::Clock::time_point{} && Tracer::beginRequest()) {
+            m_fd = fd;
+            Tracer::record(stage, fd, m_started, Tracer::Clock::now());
+        }
+    }
+    TraceRequest(const TraceRequest&) = delete;
+    TraceRequest& operator=(const TraceRequest&) = delete;
+
+private:
+    Tracer::Clock::time_point m_started{};
+    int m_fd = -1;
+};
+
+
+#endif //ASYNCSERVER_TRACER_H
@@ -0,0 +1,165 @@
+//
+// Created by roach on 19.11.2025.
+//
+
+#include "TrafficCapture.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <iostream>
+#include <unistd.h>
+
+TrafficCapture::~TrafficCapture() {
+    stop();
+}
+bool TrafficCapture::start(const std::string &path) {
+    if (isRunning()) {
+        std::cerr << "Traffic capture is already running" << std::endl;
+        return false;
+    }
+    m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (m_fd == -1) {
+        std::cerr << "Cannot open capture file " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    CaptureFileHeader header{};
+    std::memcpy(header.magic, CAPTURE_MAGIC, sizeof(header.magic));
+    header.version = CAPTURE_VERSION;
+    header.startedUnixNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    if (!writeAll(reinterpret_cast<const char*>(&header), sizeof(header))) {
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+
+    m_started = std::chrono::steady_clock::now();
+    m_stopping = false;
+    m_pending.reserve(FLUSH_THRESHOLD * 2);
+    m_writer = std::thread(&TrafficCapture::writerLoop, this);
+    std::cout << "Capturing inbound traffic to " << path << std::endl;
+    return true;
+}
+void TrafficCapture::stop() {
+    if (!isRunning()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wakeWriter.notify_one();
+    if (m_writer.joinable()) {
+        m_writer.join();
+    }
+    ::close(m_fd);
+    m_fd = -1;
+    m_connectionIds.clear();
+    std::cout << "Traffic capture stopped: " << m_records << " records, " << m_dropped << " dropped" << std::endl;
+}
+void TrafficCapture::tcpOpen(int client_fd) {
+    if (!isRunning()) {
+        return;
+    }
+    // fds are reused, connection ids are not
+    uint32_t id = m_nextConnectionId++;
+    m_connectionIds[client_fd] = id;
+    append(CaptureRecordType::TcpOpen, id, {});
+}
+void TrafficCapture::tcpData(int client_fd, std::string_view payload) {
+    if (!isRunning()) {
+        return;
+    }
+    auto it = m_connectionIds.find(client_fd);
+    if (it == m_connectionIds.end()) {
+        // Connected before the capture started
+        tcpOpen(client_fd);
+        it = m_connectionIds.find(client_fd);
+    }
+    append(CaptureRecordType::TcpData, it->second, payload);
+}
+void TrafficCapture::tcpClose(int client_fd) {
+    if (!isRunning()) {
+        return;
+    }
+    auto it = m_connectionIds.find(client_fd);
+    if (it == m_connectionIds.end()) {
+        return;
+    }
+    append(CaptureRecordType::TcpClose, it->second, {});
+    m_connectionIds.erase(it);
+}
+void TrafficCapture::udpData(std::string_view peer, std::string_view payload) {
+    if (!isRunning()) {
+        return;
+    }
+    size_t hash = std::hash<std::string_view>{}(peer);
+    append(CaptureRecordType::Udp, static_cast<uint32_t>(hash ^ (hash >> 32)), payload);
+}
+void TrafficCapture::append(CaptureRecordType type, uint32_t connectionId, std::string_view payload) {
+    CaptureRecordHeader header{};
+    header.timestampNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - m_started).count();
+    header.connectionId = connectionId;
+    header.length = static_cast<uint32_t>(payload.size());
+    header.type = type;
+
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_pending.size() + sizeof(header) + payload.size() > MAX_PENDING_BYTES) {
+            // The disk does not keep up; losing capture records beats stalling the reactor
+            ++m_dropped;
+            return;
+        }
+        const char* raw = reinterpret_cast<const char*>(&header);
+        m_pending.insert(m_pending.end(), raw, raw + sizeof(header));
+        m_pending.insert(m_pending.end(), payload.begin(), payload.end());
+        wake = m_pending.size() >= FLUSH_THRESHOLD;
+    }
+    ++m_records;
+    if (wake) {
+        m_wakeWriter.notify_one();
+    }
+}
+void TrafficCapture::writerLoop() {
+    std::vector<char> writing;
+    writing.reserve(FLUSH_THRESHOLD * 2);
+    while (true) {
+        bool stopping;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wakeWriter.wait_for(lock, FLUSH_INTERVAL, [this]() {
+                return m_stopping || m_pending.size() >= FLUSH_THRESHOLD;
+            });
+            // Swap buffers so the reactor never waits for the disk
+            writing.swap(m_pending);
+            stopping = m_stopping;
+        }
+        if (!writing.empty()) {
+            writeAll(writing.data(), writing.size());
+            writing.clear();
+        }
+        if (stopping) {
+            break;
+        }
+    }
+}
+bool TrafficCapture::writeAll(const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(m_fd, data, size);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "Capture write failed: " << strerror(errno) << std::endl;
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
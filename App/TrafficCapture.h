@@ -0,0 +1,95 @@
+//
+// Created by roach on 19.11.2025.
+//
+
+#ifndef ASYNCSERVER_TRAFFICCAPTURE_H
+#define ASYNCSERVER_TRAFFICCAPTURE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Capture log format: CaptureFileHeader, then records of CaptureRecordHeader + payload bytes.
+// All integers are little-endian as written by the host.
+enum class CaptureRecordType : uint8_t {
+    TcpOpen,
+    TcpData,
+    TcpClose,
+    Udp
+};
+
+struct CaptureFileHeader {
+    char magic[8];            // "ASCAPTR\0"
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t startedUnixNs;   // wall clock of the first record, for humans
+};
+
+struct CaptureRecordHeader {
+    uint64_t timestampNs;     // since the capture started
+    uint32_t connectionId;    // TCP connection, or hash of the UDP peer address
+    uint32_t length;          // payload bytes following the header
+    CaptureRecordType type;
+    uint8_t reserved[7];
+};
+static_assert(sizeof(CaptureRecordHeader) == 24, "capture record header must stay packed");
+
+constexpr char CAPTURE_MAGIC[8] = {'A', 'S', 'C', 'A', 'P', 'T', 'R', '\0'};
+constexpr uint32_t CAPTURE_VERSION = 1;
+
+// Appends inbound traffic to a capture log. The reactor only copies records into a memory
+// buffer; a background thread writes full buffers to the file.
+class TrafficCapture {
+public:
+    TrafficCapture() = default;
+    TrafficCapture(const TrafficCapture&) = delete;
+    TrafficCapture& operator=(const TrafficCapture&) = delete;
+    ~TrafficCapture();
+
+    bool start(const std::string& path);
+    // Flushes everything buffered and closes the file
+    void stop();
+    bool isRunning() const { return m_fd != -1; }
+
+    void tcpOpen(int client_fd);
+    void tcpData(int client_fd, std::string_view payload);
+    void tcpClose(int client_fd);
+    // peer - raw sockaddr bytes, only used to tell UDP clients apart
+    void udpData(std::string_view peer, std::string_view payload);
+
+    uint64_t getRecords() const { return m_records; }
+    uint64_t getDropped() const { return m_dropped; }
+
+private:
+    static constexpr size_t FLUSH_THRESHOLD = 256 * 1024;
+    static constexpr size_t MAX_PENDING_BYTES = 64 * 1024 * 1024;
+    static constexpr auto FLUSH_INTERVAL = std::chrono::milliseconds(100);
+
+    void append(CaptureRecordType type, uint32_t connectionId, std::string_view payload);
+    void writerLoop();
+    bool writeAll(const char* data, size_t size);
+
+    int m_fd = -1;
+    std::chrono::steady_clock::time_point m_started;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wakeWriter;
+    std::vector<char> m_pending;   // filled by the reactor, guarded by m_mutex
+    bool m_stopping = false;
+    std::thread m_writer;
+
+    // Reactor thread only
+    std::unordered_map<int, uint32_t> m_connectionIds;
+    uint32_t m_nextConnectionId = 1;
+    uint64_t m_records = 0;
+    uint64_t m_dropped = 0;
+};
+
+
+#endif //ASYNCSERVER_TRAFFICCAPTURE_H
@@ -0,0 +1,45 @@
+//
+// Created by roach on 19.11.2025.
+//
+
+#include "Transport.h"
+#include "AsyncServer.h"
+
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+SocketTransport& SocketTransport::instance() {
+    static SocketTransport transport;
+    return transport;
+}
+int SocketTransport::accept(int listen_fd, PeerAddress &addr) {
+    return ::accept4(listen_fd, addr.get(), &addr.length, SOCK_NONBLOCK);
+}
+ssize_t SocketTransport::recv(int fd, char *buffer, size_t length) {
+    return ::recv(fd, buffer, length, 0);
+}
+ssize_t SocketTransport::send(int fd, const char *data, size_t length) {
+    return ::send(fd, data, length, MSG_NOSIGNAL);
+}
+ssize_t SocketTransport::sendv(int fd, const iovec *iov, size_t count) {
+    msghdr msg{};
+    msg.msg_iov = const_cast<iovec*>(iov);
+    msg.msg_iovlen = count;
+    return ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+}
+ssize_t SocketTransport::sendfile(int fd, int file_fd, off_t *offset, size_t count) {
+    return ::sendfile(fd, file_fd, offset, count);
+}
+int SocketTransport::close(int fd) {
+    return ::close(fd);
+}
+ssize_t SocketTransport::recvfrom(int fd, char *buffer, size_t length, PeerAddress &addr) {
+    return ::recvfrom(fd, buffer, length, 0, addr.get(), &addr.length);
+}
+ssize_t SocketTransport::sendto(int fd, const char *data, size_t length, const PeerAddress &addr) {
+    return ::sendto(fd, data, length, 0, addr.get(), addr.length);
+}
+int SocketTransport::sendmmsg(int fd, mmsghdr *messages, unsigned int count) {
+    return ::sendmmsg(fd, messages, count, 0);
+}
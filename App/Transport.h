@@ -0,0 +1,54 @@
+//
+// Created by roach on 19.11.2025.
+//
+
+#ifndef ASYNCSERVER_TRANSPORT_H
+#define ASYNCSERVER_TRANSPORT_H
+
+#include <cstddef>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+struct PeerAddress;
+
+// Socket calls TCPServer makes on its listener and clients, and UDPServer on its datagram socket.
+// SocketTransport hands them to the kernel; LoopbackTransport serves them from in-process buffers.
+// Results follow the syscalls: -1 with errno set on failure, EAGAIN when nothing can be done right now.
+class Transport {
+public:
+    virtual ~Transport() = default;
+
+    virtual int accept(int listen_fd, PeerAddress& addr) = 0;
+    virtual ssize_t recv(int fd, char* buffer, size_t length) = 0;
+    virtual ssize_t send(int fd, const char* data, size_t length) = 0;
+    virtual ssize_t sendv(int fd, const iovec* iov, size_t count) = 0;
+    virtual ssize_t sendfile(int fd, int file_fd, off_t* offset, size_t count) = 0;
+    virtual int close(int fd) = 0;
+
+    // Datagram sockets
+    virtual ssize_t recvfrom(int fd, char* buffer, size_t length, PeerAddress& addr) = 0;
+    virtual ssize_t sendto(int fd, const char* data, size_t length, const PeerAddress& addr) = 0;
+    // Number of messages sent, at least one unless it fails
+    virtual int sendmmsg(int fd, mmsghdr* messages, unsigned int count) = 0;
+};
+
+class SocketTransport final : public Transport {
+public:
+    // Stateless, shared by every TCPServer that is not given another transport
+    static SocketTransport& instance();
+
+    int accept(int listen_fd, PeerAddress& addr) override;
+    ssize_t recv(int fd, char* buffer, size_t length) override;
+    ssize_t send(int fd, const char* data, size_t length) override;
+    ssize_t sendv(int fd, const iovec* iov, size_t count) override;
+    ssize_t sendfile(int fd, int file_fd, off_t* offset, size_t count) override;
+    int close(int fd) override;
+
+    ssize_t recvfrom(int fd, char* buffer, size_t length, PeerAddress& addr) override;
+    ssize_t sendto(int fd, const char* data, size_t length, const PeerAddress& addr) override;
+    int sendmmsg(int fd, mmsghdr* messages, unsigned int count) override;
+};
+
+
+#endif //ASYNCSERVER_TRANSPORT_H
@@ -0,0 +1,329 @@
+//
+// Created by roach on 19.11.2025.
+//
+
+#include "UpstreamPool.h"
+#include "TextScan.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cstring>
+#include <iostream>
+#include <netinet/tcp.h>
+#include <sstream>
+#include <unistd.h>
+
+UpstreamPool::~UpstreamPool() {
+    for (auto& [fd, connection] : m_connections) {
+        m_epollManager->removeFD(fd);
+        ::close(fd);
+    }
+}
+bool UpstreamPool::addBackend(const UpstreamConfig &config) {
+    auto backend = std::make_unique<Backend>();
+    backend->addr.sin_family = AF_INET;
+    backend->addr.sin_port = htons(config.port);
+    if (config.prefix.empty() || config.connections == 0
+        || inet_pton(AF_INET, config.host.c_str(), &backend->addr.sin_addr) != 1) {
+        std::cerr << "Invalid upstream " << config.prefix << " -> " << config.host << ":" << config.port << std::endl;
+        return false;
+    }
+    backend->prefix = config.prefix;
+    backend->address = config.host + ":" + std::to_string(config.port);
+    backend->stats.prefix = backend->prefix;
+    backend->stats.address = backend->address;
+    for (size_t i = 0; i < config.connections; ++i) {
+        auto connection = std::make_unique<Connection>();
+        connection->backend = backend.get();
+        backend->connections.push_back(std::move(connection));
+    }
+    m_backends.push_back(std::move(backend));
+    return true;
+}
+void UpstreamPool::start(EPollManager *epollManager) {
+    m_epollManager = epollManager;
+    for (auto& backend : m_backends) {
+        for (auto& connection : backend->connections) {
+            connect(*connection);
+        }
+    }
+}
+bool UpstreamPool::forward(int client_fd, std::string_view frame) {
+    auto it = std::find_if(m_backends.begin(), m_backends.end(), [frame](const auto& backend) {
+        // Whole word only: "/dbx" is not "/db"
+        const std::string& prefix = backend->prefix;
+        return frame.starts_with(prefix) && (frame.size() == prefix.size() || frame[prefix.size()] == ' ');
+    });
+    if (it == m_backends.end()) {
+        return false;
+    }
+    Backend& backend = **it;
+    ++backend.stats.requests;
+
+    Connection* connection = pickConnection(backend, client_fd);
+    if (!connection) {
+        ++backend.stats.errors;
+        reply(client_fd, "ERR upstream " + backend.prefix + " unavailable\n");
+        return true;
+    }
+    if (connection->pending.size() >= MAX_IN_FLIGHT || connection->output.size() + frame.size() >= MAX_OUTPUT_BYTES) {
+        ++backend.stats.errors;
+        reply(client_fd, "ERR upstream " + backend.prefix + " busy\n");
+        return true;
+    }
+
+    connection->output.append(frame);
+    connection->output.push_back('\n');
+    connection->pending.push_back({client_fd, LoopClock::now()});
+    ++backend.pinned.try_emplace(client_fd, Pin{connection, 0}).first->second.pending;
+    flush(*connection);
+    return true;
+}
+void UpstreamPool::removeClient(int client_fd) {
+    for (auto& backend : m_backends) {
+        backend->pinned.erase(client_fd);
+    }
+    for (auto& [fd, connection] : m_connections) {
+        for (auto& request : connection->pending) {
+            if (request.client_fd == client_fd) {
+                request.client_fd = -1;
+            }
+        }
+    }
+}
+void UpstreamPool::handleEvent(int fd, uint32_t events) {
+    auto it = m_connections.find(fd);
+    if (it == m_connections.end()) {
+        return;
+    }
+    Connection& connection = *it->second;
+
+    if (!connection.connected) {
+        // Non-blocking connect finished, successfully or not
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (::getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) == -1) {
+            error = errno;
+        }
+        if (error != 0 || (events & (EPOLLERR | EPOLLHUP))) {
+            ++connection.backend->stats.connectFailures;
+            drop(connection, error ? strerror(error) : "connect failed");
+            return;
+        }
+        if (!(events & EPOLLOUT)) {
+            return;
+        }
+        connection.connected = true;
+        connection.backoff = MIN_BACKOFF;
+        std::cout << "Upstream " << connection.backend->prefix << " connected to "
+                  << connection.backend->address << " (fd: " << fd << ")" << std::endl;
+    }
+
+    if ((events & (EPOLLIN | EPOLLRDHUP)) && !readReplies(connection)) {
+        return;
+    }
+    if ((events & EPOLLOUT) && !flush(connection)) {
+        return;
+    }
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        drop(connection, "socket error");
+    }
+}
+void UpstreamPool::runTimers() {
+    if (!m_epollManager) {
+        return;
+    }
+    const auto now = LoopClock::now();
+    for (auto& backend : m_backends) {
+        for (auto& connection : backend->connections) {
+            if (connection->fd == -1 && now >= connection->retryAt) {
+                connect(*connection);
+            }
+        }
+    }
+}
+std::vector<UpstreamPool::BackendStats> UpstreamPool::getStats() const {
+    std::vector<BackendStats> result;
+    result.reserve(m_backends.size());
+    for (const auto& backend : m_backends) {
+        BackendStats stats = backend->stats;
+        stats.connections = backend->connections.size();
+        for (const auto& connection : backend->connections) {
+            stats.connected += connection->connected ? 1 : 0;
+            stats.inFlight += connection->pending.size();
+        }
+        result.push_back(std::move(stats));
+    }
+    return result;
+}
+std::string UpstreamPool::formatStats() const {
+    std::ostringstream oss;
+    oss << "Upstreams: " << m_backends.size();
+    for (const BackendStats& stats : getStats()) {
+        oss << "\n\t" << stats.prefix << " -> " << stats.address << ": " << (stats.connected ? "up" : "down")
+            << ", " << stats.connected << "/" << stats.connections << " connected"
+            << ", " << stats.inFlight << " in flight"
+            << ", " << stats.requests << " requests, " << stats.responses << " replies, " << stats.errors << " errors"
+            << ", " << stats.connectFailures << " connect failures"
+            << ", latency p50 < " << stats.latency.quantileUs(0.5) << " us, p99 < " << stats.latency.quantileUs(0.99) << " us";
+    }
+    return oss.str();
+}
+bool UpstreamPool::connect(Connection &connection) {
+    Backend& backend = *connection.backend;
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        std::cerr << "Upstream socket failed: " << strerror(errno) << std::endl;
+        connection.retryAt = LoopClock::now() + connection.backoff;
+        return false;
+    }
+    // Replies are small and latency bound
+    int opt = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&backend.addr), sizeof(backend.addr)) == -1 && errno != EINPROGRESS) {
+        std::cerr << "Upstream " << backend.prefix << " connect to " << backend.address
+                  << " failed: " << strerror(errno) << std::endl;
+        ::close(fd);
+        ++backend.stats.connectFailures;
+        connection.retryAt = LoopClock::now() + connection.backoff;
+        connection.backoff = std::min(connection.backoff * 2, MAX_BACKOFF);
+        return false;
+    }
+
+    try {
+        // Completion of the connect is reported as EPOLLOUT
+        m_epollManager->addFD(fd, CONNECTION_EVENTS);
+    } catch (const std::exception &e) {
+        std::cerr << "Upstream epoll add failed: " << e.what() << std::endl;
+        ::close(fd);
+        connection.retryAt = LoopClock::now() + connection.backoff;
+        return false;
+    }
+    connection.fd = fd;
+    m_connections[fd] = &connection;
+    return true;
+}
+void UpstreamPool::drop(Connection &connection, const char *reason) {
+    Backend& backend = *connection.backend;
+    std::cerr << "Upstream " << backend.prefix << " connection " << connection.fd << " to "
+              << backend.address << " dropped: " << reason << std::endl;
+
+    m_epollManager->removeFD(connection.fd);
+    ::close(connection.fd);
+    m_connections.erase(connection.fd);
+    connection.fd = -1;
+    connection.connected = false;
+    connection.output.clear();
+    connection.input.clear();
+    connection.retryAt = LoopClock::now() + connection.backoff;
+    connection.backoff = std::min(connection.backoff * 2, MAX_BACKOFF);
+
+    // Replies may disconnect clients, which edits pending lists, so fail a detached copy
+    std::deque<PendingRequest> failed;
+    failed.swap(connection.pending);
+    const std::string error = "ERR upstream " + backend.prefix + " " + reason + "\n";
+    for (const PendingRequest& request : failed) {
+        ++backend.stats.errors;
+        unpin(backend, request.client_fd);
+        reply(request.client_fd, error);
+    }
+}
+bool UpstreamPool::flush(Connection &connection) {
+    if (!connection.connected) {
+        return true;
+    }
+    size_t sent = 0;
+    while (sent < connection.output.size()) {
+        ssize_t bytes = ::send(connection.fd, connection.output.data() + sent, connection.output.size() - sent, MSG_NOSIGNAL);
+        if (bytes == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // The rest goes out on the next EPOLLOUT edge
+                break;
+            }
+            drop(connection, strerror(errno));
+            return false;
+        }
+        sent += static_cast<size_t>(bytes);
+    }
+    connection.output.erase(0, sent);
+    return true;
+}
+bool UpstreamPool::readReplies(Connection &connection) {
+    constexpr size_t BUFFER_SIZE = 16 * 1024;
+    char buffer[BUFFER_SIZE];
+    Backend& backend = *connection.backend;
+
+    while (true) {
+        ssize_t bytes = ::recv(connection.fd, buffer, BUFFER_SIZE, 0);
+        if (bytes == 0) {
+            drop(connection, "closed by backend");
+            return false;
+        }
+        if (bytes == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return true;
+            }
+            drop(connection, strerror(errno));
+            return false;
+        }
+        connection.input.append(buffer, static_cast<size_t>(bytes));
+
+        size_t consumed = 0;
+        std::string_view rest(connection.input);
+        while (true) {
+            size_t newline = TextScan::find(rest.substr(consumed), '\n');
+            if (newline == std::string_view::npos) {
+                break;
+            }
+            std::string line(rest.substr(consumed, newline + 1));
+            consumed += newline + 1;
+            if (connection.pending.empty()) {
+                drop(connection, "reply without a request");
+                return false;
+            }
+            PendingRequest request = connection.pending.front();
+            connection.pending.pop_front();
+            ++backend.stats.responses;
+            backend.stats.latency.add(elapsedNs(request.sentAt, LoopClock::now()));
+            unpin(backend, request.client_fd);
+            reply(request.client_fd, line);
+        }
+        connection.input.erase(0, consumed);
+        if (connection.input.size() > MAX_REPLY_BYTES) {
+            drop(connection, "reply too long");
+            return false;
+        }
+    }
+}
+UpstreamPool::Connection* UpstreamPool::pickConnection(Backend &backend, int client_fd) {
+    // Replies are ordered per connection only, so a client with requests in flight stays where they are,
+    // even after its preferred connection comes back. drop() unpins everything it fails
+    auto pin = backend.pinned.find(client_fd);
+    if (pin != backend.pinned.end()) {
+        return pin->second.connection;
+    }
+    Connection& preferred = *backend.connections[static_cast<size_t>(client_fd) % backend.connections.size()];
+    if (preferred.connected) {
+        return &preferred;
+    }
+    // Otherwise the least loaded live connection keeps the FIFO queues short
+    Connection* best = nullptr;
+    for (auto& connection : backend.connections) {
+        if (connection->connected && (!best || connection->pending.size() < best->pending.size())) {
+            best = connection.get();
+        }
+    }
+    return best;
+}
+void UpstreamPool::unpin(Backend &backend, int client_fd) {
+    auto pin = backend.pinned.find(client_fd);
+    if (pin != backend.pinned.end() && --pin->second.pending == 0) {
+        backend.pinned.erase(pin);
+    }
+}
+void UpstreamPool::reply(int client_fd, const std::string &line) {
+    if (client_fd != -1 && m_tcpServer->hasClient(client_fd)) {
+        m_tcpServer->sendData(client_fd, line);
+    }
+}
@@ -0,0 +1,118 @@
+//
+// Created by roach on 19.11.2025.
+//
+
+#ifndef ASYNCSERVER_UPSTREAMPOOL_H
+#define ASYNCSERVER_UPSTREAMPOOL_H
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "AsyncServer.h"
+
+// Proxy mode: frames whose first word is a configured prefix are forwarded to a backend over a pool of
+// persistent non-blocking connections living in the reactor's epoll set. The backend answers
+// every request with one '\n'-terminated line, so requests of many clients are pipelined on the
+// same connection and replies are matched to them in FIFO order. A client's forwarded requests
+// are answered in order; local commands sent in between may overtake them.
+class UpstreamPool {
+public:
+    struct BackendStats {
+        std::string prefix;
+        std::string address;
+        size_t connected = 0;
+        size_t connections = 0;
+        size_t inFlight = 0;
+        uint64_t requests = 0;
+        uint64_t responses = 0;
+        uint64_t errors = 0;       // requests answered with ERR by the proxy itself
+        uint64_t connectFailures = 0;
+        LatencySketch latency;     // request sent -> reply line received
+    };
+
+    explicit UpstreamPool(TCPServer* tcpServer) : m_tcpServer(tcpServer) {}
+    UpstreamPool(const UpstreamPool&) = delete;
+    UpstreamPool& operator=(const UpstreamPool&) = delete;
+    ~UpstreamPool();
+
+    // Connections are opened by start(); false when host is not an IPv4 address
+    bool addBackend(const UpstreamConfig& config);
+    void start(EPollManager* epollManager);
+    bool empty() const { return m_backends.empty(); }
+
+    // true when the frame was taken by a backend; the reply (or an ERR line) is sent to the client later
+    bool forward(int client_fd, std::string_view frame);
+    // Replies still in flight for this client are dropped, its fd number may be reused
+    void removeClient(int client_fd);
+
+    bool owns(int fd) const { return m_connections.find(fd) != m_connections.end(); }
+    void handleEvent(int fd, uint32_t events);
+    // Reconnects dropped connections once their backoff has passed
+    void runTimers();
+
+    std::vector<BackendStats> getStats() const;
+    std::string formatStats() const;
+
+private:
+    static constexpr size_t MAX_IN_FLIGHT = 1024;   // per connection
+    static constexpr size_t MAX_OUTPUT_BYTES = 1024 * 1024;
+    static constexpr size_t MAX_REPLY_BYTES = 1024 * 1024;
+    static constexpr auto MIN_BACKOFF = std::chrono::milliseconds(100);
+    static constexpr auto MAX_BACKOFF = std::chrono::milliseconds(5000);
+    static constexpr uint32_t CONNECTION_EVENTS = EPOLLIN | EPOLLOUT | EPOLLET | EPOLLRDHUP;
+
+    struct Backend;
+
+    struct PendingRequest {
+        int client_fd;               // -1 once the client is gone
+        LoopClock::time_point sentAt;
+    };
+
+    struct Connection {
+        Backend* backend = nullptr;
+        int fd = -1;
+        bool connected = false;
+        std::string output;          // requests not yet accepted by the socket
+        std::string input;           // partial reply line
+        std::deque<PendingRequest> pending;
+        std::chrono::milliseconds backoff = MIN_BACKOFF;
+        LoopClock::time_point retryAt;
+    };
+
+    // Connection a client's requests are in flight on
+    struct Pin {
+        Connection* connection;
+        size_t pending;
+    };
+
+    struct Backend {
+        std::string prefix;
+        sockaddr_in addr{};
+        std::string address;
+        std::vector<std::unique_ptr<Connection>> connections;
+        std::unordered_map<int, Pin> pinned;   // by client fd, while it has requests in flight
+        BackendStats stats;
+    };
+
+    bool connect(Connection& connection);
+    // Closes the socket, fails its pending requests and schedules a reconnect
+    void drop(Connection& connection, const char* reason);
+    bool flush(Connection& connection);
+    bool readReplies(Connection& connection);
+    Connection* pickConnection(Backend& backend, int client_fd);
+    // One request of the client on this backend was answered or failed
+    static void unpin(Backend& backend, int client_fd);
+    void reply(int client_fd, const std::string& line);
+
+    EPollManager* m_epollManager = nullptr;
+    TCPServer* m_tcpServer;
+    std::vector<std::unique_ptr<Backend>> m_backends;
+    std::unordered_map<int, Connection*> m_connections;
+};
+
+
+#endif //ASYNCSERVER_UPSTREAMPOOL_H
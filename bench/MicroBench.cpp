@@ -0,0 +1,225 @@
+// Микробенчмарки горячего пути сообщений.
+//     ./AsyncServerBench [iterations]
+// Замеры loopback гоняют весь конвейер AsyncServer без ядра: iterations / 10 сообщений.
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "App/AsyncServer.h"
+#include "App/LoopbackTransport.h"
+#include "App/TextScan.h"
+
+namespace {
+    template<typename Body>
+    double runBenchmark(const char* name, size_t iterations, Body&& body) {
+        for (size_t i = 0; i < iterations / 10; ++i) {
+            body(i);
+        }
+        auto started = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i) {
+            body(i);
+        }
+        auto elapsed = std::chrono::steady_clock::now() - started;
+        double ns = std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+        std::cout << std::left << std::setw(44) << name << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(10) << ns << " ns/op" << std::endl;
+        return ns;
+    }
+
+    // Same shape as AsyncServer::handleTCPData before the command lookup: trim and classify
+    struct CountingHandler {
+        size_t commands = 0;
+        size_t bytes = 0;
+
+        void onTcpData(int client_fd, const std::string& data) {
+            size_t end = data.size();
+            while (end > 0 && (data[end - 1] == '\n' || data[end - 1] == '\r' || data[end - 1] == ' ')) {
+                --end;
+            }
+            if (end > 0 && data[0] == '/') {
+                ++commands;
+            }
+            bytes += end + (client_fd & 1);
+        }
+    };
+
+    // TCPServer::handleClientData over LoopbackTransport: recv, per-client bookkeeping and the
+    // handler call, once through a DataCallback and once through the static handler policy.
+    // Both loops are instantiated here, so they are built with the same optimization level.
+    void benchDispatch(size_t iterations) {
+        const std::vector<std::string> messages = {"hello\n", "/time\n", "/stats\n", "/get some-key\n"};
+
+        CountingHandler callbackTarget;
+        CountingHandler staticHandler;
+        double viaCallback = 0;
+        double viaPolicy = 0;
+        // TCPServer сообщает о подключениях и остановке в cout
+        std::streambuf* console = std::cout.rdbuf(nullptr);
+        {
+            LoopbackTransport loopback;
+            TCPServer server;
+            server.attach(loopback.getListenFD(), &loopback, &loopback);
+            int server_fd = -1;
+            server.setConnectCallback([&server_fd](int client_fd, const PeerAddress&) { server_fd = client_fd; });
+            int client = loopback.connect();
+            server.handleNewConnection(loopback.getListenFD());
+
+            TCPServer::DataCallback callback = [&callbackTarget](int client_fd, const std::string& data) {
+                callbackTarget.onTcpData(client_fd, data);
+            };
+            TCPServer::CallbackHandler callbackHandler{callback};
+
+            std::cout.rdbuf(console);
+            std::cout.clear();
+            viaCallback = runBenchmark("dispatch: std::function callback", iterations, [&](size_t i) {
+                loopback.write(client, messages[i & 3]);
+                server.handleClientData(server_fd, callbackHandler);
+            });
+            viaPolicy = runBenchmark("dispatch: static handler policy", iterations, [&](size_t i) {
+                loopback.write(client, messages[i & 3]);
+                server.handleClientData(server_fd, staticHandler);
+            });
+            std::cout.rdbuf(nullptr);
+        }
+        std::cout.rdbuf(console);
+        std::cout.clear();
+
+        std::cout << "  speedup x" << std::setprecision(2) << viaCallback / viaPolicy
+                  << " (checksum " << callbackTarget.bytes + staticHandler.bytes << ")" << std::endl;
+    }
+
+    // Framing of one receive buffer the way AsyncServer::handleTCPData does it
+    size_t countFrames(std::string_view data) {
+        size_t commands = 0;
+        while (!data.empty()) {
+            size_t newline = TextScan::find(data, '\n');
+            std::string_view frame = TextScan::trimRight(data.substr(0, newline));
+            data = newline == std::string_view::npos ? std::string_view() : data.substr(newline + 1);
+            commands += TextScan::isCommand(frame) ? 2 : frame.empty() ? 0 : 1;
+        }
+        return commands;
+    }
+
+    // The old trimNetworkData: byte loop plus a substr copy
+    std::string trimCopy(const std::string& data) {
+        size_t end = data.length();
+        while (end > 0 && (data[end-1] == '\n' || data[end-1] == '\r' || data[end-1] == ' ' || data[end-1] == '\t')) {
+            end--;
+        }
+        return data.substr(0, end);
+    }
+
+    void benchScan(size_t iterations) {
+        const std::string shortInput = "/get some-key   \r\n";
+        // A pipelined read: 64 lines of ~60 bytes, the last one with a long run of padding
+        std::string longInput;
+        for (int line = 0; line < 64; ++line) {
+            longInput += (line % 3 ? "payload line number " : "/set key-") + std::to_string(line)
+                         + std::string(32, 'x') + "\n";
+        }
+        longInput += std::string(200, ' ') + "\n";
+
+        size_t checksum = 0;
+        runBenchmark("trim: byte loop + substr (short)", iterations, [&](size_t i) {
+            checksum += trimCopy(shortInput).size() + (i & 1);
+        });
+
+        const TextScan::Kernel active = TextScan::getKernel();
+        for (TextScan::Kernel kernel : {TextScan::Kernel::Scalar, TextScan::Kernel::Sse2, TextScan::Kernel::Avx2}) {
+            if (!TextScan::useKernel(kernel)) {
+                std::cout << "scan: " << TextScan::kernelName(kernel) << " not supported by this CPU" << std::endl;
+                continue;
+            }
+            std::string name = std::string("scan: ") + TextScan::kernelName(kernel);
+            runBenchmark((name + " frame+trim (short)").c_str(), iterations, [&](size_t i) {
+                checksum += countFrames(shortInput) + (i & 1);
+            });
+            runBenchmark((name + " frame+trim (4 KiB, 65 frames)").c_str(), iterations / 100, [&](size_t i) {
+                checksum += countFrames(longInput) + (i & 1);
+            });
+        }
+        TextScan::useKernel(active);
+        std::cout << "  runtime kernel: " << TextScan::kernelName(active) << " (checksum " << checksum << ")" << std::endl;
+    }
+
+    // Весь конвейер AsyncServer (accept, recv, разбор, команда, ответ) поверх LoopbackTransport:
+    // без сокетов и epoll, так что время - чисто пользовательский код.
+    // Каждый ответ сверяется с reply: клиент получает их подряд, по одному на строку.
+    void benchLoopback(const char* name, const std::string& line, const std::string& reply, size_t messages) {
+        constexpr size_t CLIENTS = 16;
+        constexpr size_t LINES_PER_WRITE = 32;
+
+        // Сервер пишет в cout на каждое сообщение, в замер это не должно попасть
+        std::streambuf* console = std::cout.rdbuf(nullptr);
+        size_t sent = 0;
+        size_t received = 0;
+        size_t mismatched = 0;
+        const size_t expected = messages / (CLIENTS * LINES_PER_WRITE) * CLIENTS * LINES_PER_WRITE * reply.size();
+        std::string batch;
+        for (size_t i = 0; i < LINES_PER_WRITE; ++i) {
+            batch += line;
+        }
+        LoopClock::duration elapsed{};
+        {
+            AsyncServer server;
+            auto owned = std::make_unique<LoopbackTransport>();
+            LoopbackTransport& loopback = *owned;
+            server.setLoopback(std::move(owned));
+
+            std::vector<int> clients;
+            std::vector<size_t> replyOffsets(CLIENTS, 0);   // позиция внутри reply, ответ может прийти частями
+            for (size_t i = 0; i < CLIENTS; ++i) {
+                clients.push_back(loopback.connect());
+            }
+            // Хук вызывается, когда реактору больше нечего делать: всё отправленное уже обработано
+            loopback.setIdleHook([&]() {
+                for (size_t i = 0; i < CLIENTS; ++i) {
+                    std::string data = loopback.read(clients[i]);
+                    for (char c : data) {
+                        mismatched += c != reply[replyOffsets[i]];
+                        replyOffsets[i] = (replyOffsets[i] + 1) % reply.size();
+                    }
+                    received += data.size();
+                }
+                if (sent * reply.size() >= expected) {
+                    server.shutdown();
+                    return;
+                }
+                for (int client : clients) {
+                    loopback.write(client, batch);
+                    sent += LINES_PER_WRITE;
+                }
+            });
+
+            auto started = LoopClock::now();
+            server.exec();
+            elapsed = LoopClock::now() - started;
+        }
+        std::cout.rdbuf(console);
+        std::cout.clear();
+
+        double seconds = std::chrono::duration<double>(elapsed).count();
+        std::cout << std::left << std::setw(44) << name << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(10) << seconds * 1e9 / sent << " ns/msg, "
+                  << std::setprecision(0) << sent / seconds << " msg/s";
+        if (received != expected || mismatched != 0) {
+            std::cout << " (REPLY MISMATCH: " << received << " of " << expected << " bytes, "
+                      << mismatched << " wrong)";
+        }
+        std::cout << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    size_t iterations = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 20'000'000;
+
+    benchDispatch(iterations);
+    benchScan(iterations);
+    benchLoopback("loopback: echo", "ping\n", "ping\n", iterations / 10);
+    benchLoopback("loopback: /set (kv)", "/set key value\n", "OK\n", iterations / 10);
+    return 0;
+}
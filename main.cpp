@@ -1,8 +1,93 @@
 // Пример использования:
+//     ./AsyncServer --unix /tmp/async-server.sock --slow-callback-ms 5
+//     ./AsyncServer --busy-poll 2        # крутится на ядре 2 вместо блокирующего epoll_wait
+//     ./AsyncServer --stats-shm /async-server-stats   # читать: ./AsyncServerStats /async-server-stats
+//     ./AsyncServer --files /srv/blobs   # /get-file <name> отдаёт файлы из этого каталога
+//     ./AsyncServer --capture /tmp/traffic.cap   # воспроизвести: ./AsyncServerReplay /tmp/traffic.cap 127.0.0.77 8080 max
+//     ./AsyncServer --read-budget 16384   # не больше 16 КБ с одного клиента за итерацию цикла
+//     ./AsyncServer --admin-port 8081   # соединения на этот порт обслуживаются вне очереди, даже под нагрузкой
+//     ./AsyncServer --upstream /db=127.0.0.1:9090   # команды на /db уходят на бэкенд, /upstreams - его состояние
+//     ./AsyncServer --trace-sample 100   # трассировка каждого сотого запроса, дамп: kill -USR1 <pid>
+//     ./AsyncServer --session echo   # каждое TCP соединение обслуживает корутина Session вместо команд
+
+#include <iostream>
+#include <string>
 
 #include "App/AsyncServer.h"
-int main() {
+int main(int argc, char* argv[]) {
     AsyncServer server("127.0.0.77", 8080);
+
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for option " << option << std::endl;
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (option == "--unix") {
+            server.setUnixSocketPath(value);
+        } else if (option == "--busy-poll") {
+            // value: CPU to pin the reactor to, -1 to spin without pinning
+            BusyPollConfig busyPoll;
+            busyPoll.enabled = true;
+            busyPoll.cpu = std::atoi(value.c_str());
+            server.setBusyPoll(busyPoll);
+        } else if (option == "--files") {
+            if (!server.setFileDirectory(value)) {
+                return 1;
+            }
+        } else if (option == "--upstream") {
+            // value: PREFIX=HOST:PORT
+            size_t eq = value.find('=');
+            size_t colon = value.rfind(':');
+            if (eq == std::string::npos || colon == std::string::npos || colon < eq) {
+                std::cerr << "Expected --upstream PREFIX=HOST:PORT, got " << value << std::endl;
+                return 1;
+            }
+            UpstreamConfig upstream;
+            upstream.prefix = value.substr(0, eq);
+            upstream.host = value.substr(eq + 1, colon - eq - 1);
+            upstream.port = std::atoi(value.c_str() + colon + 1);
+            if (!server.addUpstream(upstream)) {
+                return 1;
+            }
+        } else if (option == "--admin-port") {
+            server.setAdminPort(std::atoi(value.c_str()));
+        } else if (option == "--read-budget") {
+            // value: bytes one client may read per loop iteration, 0 - unlimited
+            ReadBudget budget;
+            budget.bytes = std::strtoull(value.c_str(), nullptr, 10);
+            if (budget.bytes == 0) {
+                budget.reads = 0;
+            }
+            server.setReadBudget(budget);
+        } else if (option == "--capture") {
+            server.setCaptureFile(value);
+        } else if (option == "--stats-shm") {
+            server.setStatsSegment(value);
+        } else if (option == "--trace-sample") {
+            server.setTraceSampling(static_cast<uint32_t>(std::atoi(value.c_str())));
+        } else if (option == "--session") {
+            // value: echo - строка в ответ на строку; write() ждёт, пока клиент не вычитает предыдущий ответ
+            if (value != "echo") {
+                std::cerr << "Unknown session handler: " << value << std::endl;
+                return 1;
+            }
+            server.setSessionHandler([](Session& session) -> SessionTask {
+                while (auto frame = co_await session.read()) {
+                    if (!co_await session.write(*frame + "\n")) {
+                        break;
+                    }
+                }
+            });
+        } else if (option == "--slow-callback-ms") {
+            server.setSlowCallbackThreshold(std::chrono::milliseconds(std::atoi(value.c_str())));
+        } else {
+            std::cerr << "Unknown option: " << option << std::endl;
+            return 1;
+        }
+    }
+
     server.exec();  // Запускает сервер
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,87 @@
+// Проверки лимита памяти KeyValueStore: лимит считается по зарезервированной памяти арены и таблице слотов.
+//     ./AsyncServerKeyValueTest
+// Результаты в stderr, код возврата 0 - все проверки прошли.
+
+#include <iostream>
+#include <string>
+
+#include "App/KeyValueStore.h"
+
+namespace {
+    int failures = 0;
+
+    void check(bool ok, const std::string& what) {
+        if (!ok) {
+            ++failures;
+        }
+        std::cerr << (ok ? "✓ " : "✗ ") << what << std::endl;
+    }
+
+    size_t memoryUsed(const KeyValueStore& store) {
+        return store.getStats().memoryUsed;
+    }
+
+    void testLimitHoldsWhileTableGrows() {
+        constexpr size_t LIMIT = 1024 * 1024;
+        KeyValueStore store(LIMIT);
+        bool withinLimit = true;
+        // Мелкие ключи: таблица слотов удваивается много раз, пока не упрётся в лимит
+        for (size_t i = 0; i < 200000 && withinLimit; ++i) {
+            store.set("k" + std::to_string(i), "v");
+            withinLimit = memoryUsed(store) <= LIMIT;
+        }
+        check(withinLimit, "table growth stays within the memory limit");
+        check(store.getStats().evictions > 0, "limit reached by table growth evicts keys");
+    }
+
+    void testChunksReturnedAfterChurn() {
+        constexpr size_t LIMIT = 4 * 1024 * 1024;
+        constexpr size_t KEYS = 2000;
+        KeyValueStore store(LIMIT);
+        bool withinLimit = true;
+        for (size_t i = 0; i < KEYS; ++i) {
+            store.set("small" + std::to_string(i), std::string(40, 's'));
+            withinLimit = withinLimit && memoryUsed(store) <= LIMIT;
+        }
+        for (size_t i = 0; i < KEYS; ++i) {
+            store.del("small" + std::to_string(i));
+        }
+        const size_t emptyUsed = memoryUsed(store);
+
+        // Другой класс размеров: память мелких блоков уже вернулась, старые куски не копятся
+        for (size_t i = 0; i < KEYS; ++i) {
+            store.set("big" + std::to_string(i), std::string(1500, 'b'));
+            withinLimit = withinLimit && memoryUsed(store) <= LIMIT;
+        }
+        for (size_t i = 0; i < KEYS; ++i) {
+            store.del("big" + std::to_string(i));
+        }
+        check(withinLimit, "churn across size classes stays within the memory limit");
+        check(memoryUsed(store) == emptyUsed, "empty store keeps no arena chunks");
+
+        // Свободных блоков нет: первый ключ резервирует целый кусок, и он учитывается
+        store.set("one", "1");
+        const size_t withOne = memoryUsed(store);
+        store.del("one");
+        check(withOne >= emptyUsed + 64 * 1024 && memoryUsed(store) == emptyUsed,
+              "reserved chunk counted while in use and returned when empty");
+    }
+
+    void testTooLargeForLimit() {
+        KeyValueStore store(512 * 1024);
+        store.set("kept", "value");
+        bool rejected = !store.set("kept", std::string(600 * 1024, 'x'));
+        auto value = store.get("kept");
+        check(rejected && value && *value == "value", "value over the limit rejected, old value kept");
+    }
+}
+
+int main() {
+    testLimitHoldsWhileTableGrows();
+    testChunksReturnedAfterChurn();
+    testTooLargeForLimit();
+
+    std::cerr << (failures == 0 ? "All key-value tests passed" : std::to_string(failures) + " key-value checks failed")
+              << std::endl;
+    return failures == 0 ? 0 : 1;
+}
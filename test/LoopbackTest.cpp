@@ -0,0 +1,270 @@
+// Сквозные проверки AsyncServer поверх LoopbackTransport: весь конвейер без сокетов и epoll,
+// поэтому порядок событий детерминирован.
+//     ./AsyncServerLoopbackTest
+// Результаты в stderr, код возврата 0 - все проверки прошли.
+
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "App/AsyncServer.h"
+#include "App/LoopbackTransport.h"
+
+namespace {
+    int failures = 0;
+
+    void check(bool ok, const std::string& what) {
+        if (!ok) {
+            ++failures;
+        }
+        std::cerr << (ok ? "✓ " : "✗ ") << what << std::endl;
+    }
+
+    // Шаг сценария возвращает false, если его надо повторить: ответ ещё не пришёл целиком
+    using Step = std::function<bool()>;
+
+    class Harness {
+    public:
+        Harness() {
+            auto owned = std::make_unique<LoopbackTransport>();
+            m_loopback = owned.get();
+            m_server.setLoopback(std::move(owned));
+        }
+
+        AsyncServer& server() { return m_server; }
+        LoopbackTransport& loopback() { return *m_loopback; }
+
+        // Шаги выполняются из idle-хука: к началу шага сервер обработал всё отправленное раньше.
+        // false, если сценарий застрял на каком-то шаге
+        bool run(std::vector<Step> steps) {
+            constexpr size_t MAX_IDLE_CALLS = 100000;
+            size_t next = 0;
+            size_t idleCalls = 0;
+            m_loopback->setIdleHook([&]() {
+                if (next == steps.size() || ++idleCalls > MAX_IDLE_CALLS) {
+                    m_server.shutdown();
+                    return;
+                }
+                if (steps[next]()) {
+                    ++next;
+                }
+            });
+            m_server.exec();
+            return next == steps.size();
+        }
+
+    private:
+        AsyncServer m_server;
+        LoopbackTransport* m_loopback = nullptr;
+    };
+
+    void testEcho() {
+        Harness harness;
+        LoopbackTransport& loopback = harness.loopback();
+        int client = loopback.connect();
+        std::string echoed;
+        std::string beforeNewline;
+        std::string joined;
+        bool finished = harness.run({
+            [&]() { loopback.write(client, "hello\n"); return true; },
+            [&]() { echoed = loopback.read(client); loopback.write(client, "pi"); return true; },
+            // Строка без '\n' ждёт продолжения и не считается запросом
+            [&]() { beforeNewline = loopback.read(client); loopback.write(client, "ng\n"); return true; },
+            [&]() { joined = loopback.read(client); return true; },
+        });
+        check(finished && echoed == "hello\n", "echo");
+        check(finished && beforeNewline.empty() && joined == "ping\n", "line split across writes");
+    }
+
+    void testPipelinedKeyValue() {
+        Harness harness;
+        LoopbackTransport& loopback = harness.loopback();
+        int client = loopback.connect();
+        std::string replies;
+        bool finished = harness.run({
+            [&]() { loopback.write(client, "/set a 1\n/set b 2\n/get a\n/get b\n/get c\n"); return true; },
+            [&]() { replies = loopback.read(client); return true; },
+        });
+        check(finished && replies == "OK\nOK\n1\n2\n(nil)\n", "pipelined /set and /get");
+    }
+
+    void testBackpressure() {
+        constexpr size_t LIMIT = 64;
+        Harness harness;
+        LoopbackTransport& loopback = harness.loopback();
+        loopback.setClientBufferLimit(LIMIT);
+        int client = loopback.connect();
+        const std::string line = std::string(1000, 'x') + "\n";
+        std::string received;
+        bool bounded = true;
+        bool finished = harness.run({
+            [&]() { loopback.write(client, line); return true; },
+            // Остаток ответа сервер досылает по EPOLLOUT после каждого чтения клиента
+            [&]() {
+                bounded = bounded && loopback.readable(client) <= LIMIT;
+                received += loopback.read(client);
+                return received.size() >= line.size();
+            },
+        });
+        check(finished && bounded && received == line, "reply paced by a full client buffer");
+    }
+
+    void testDisconnect() {
+        Harness harness;
+        LoopbackTransport& loopback = harness.loopback();
+        int leaving = loopback.connect();
+        int staying = loopback.connect();
+        int publisher = loopback.connect();
+        std::string published;
+        std::string delivered;
+        bool finished = harness.run({
+            [&]() {
+                loopback.write(leaving, "/subscribe news\n");
+                loopback.write(staying, "/subscribe news\n");
+                return true;
+            },
+            [&]() {
+                loopback.read(leaving);
+                loopback.read(staying);
+                loopback.disconnect(leaving);
+                return true;
+            },
+            [&]() { loopback.write(publisher, "/publish news breaking\n"); return true; },
+            [&]() {
+                published = loopback.read(publisher);
+                delivered = loopback.read(staying);
+                return true;
+            },
+        });
+        check(finished && published == "Published to 1 subscribers\n", "disconnected client left its topics");
+        check(finished && delivered.find("breaking") != std::string::npos, "remaining subscriber served");
+    }
+
+    // Обработчик сессии: корутина без захватов, счётчик общий
+    size_t sessionWrites = 0;
+
+    SessionTask echoSession(Session& session) {
+        while (auto frame = co_await session.read()) {
+            if (!co_await session.write(*frame + "\n")) {
+                break;
+            }
+            ++sessionWrites;
+        }
+    }
+
+    void testSessionWriteWaitsForDrain() {
+        constexpr size_t LIMIT = 64;
+        constexpr size_t LINES = 50;
+        Harness harness;
+        LoopbackTransport& loopback = harness.loopback();
+        harness.server().setSessionHandler(echoSession);
+        loopback.setClientBufferLimit(LIMIT);
+        int client = loopback.connect();
+        std::string lines;
+        for (size_t i = 0; i < LINES; ++i) {
+            lines += "line " + std::to_string(i) + std::string(100, '.') + "\n";
+        }
+        sessionWrites = 0;
+        size_t writesBeforeRead = 0;
+        std::string received;
+        bool finished = harness.run({
+            [&]() { loopback.write(client, lines); return true; },
+            [&]() {
+                // Первый ответ не влез в буфер клиента: обработчик ждёт в write(), дальше не идёт
+                writesBeforeRead = sessionWrites;
+                return true;
+            },
+            [&]() {
+                received += loopback.read(client);
+                return received.size() >= lines.size();
+            },
+        });
+        check(finished && writesBeforeRead == 0, "session write() waits for the output queue to drain");
+        check(finished && received == lines && sessionWrites == LINES, "session echo completed after the reader caught up");
+    }
+
+    void testSessionDisconnectWhileWriting() {
+        Harness harness;
+        LoopbackTransport& loopback = harness.loopback();
+        harness.server().setSessionHandler(echoSession);
+        loopback.setClientBufferLimit(16);
+        int client = loopback.connect();
+        sessionWrites = 0;
+        bool finished = harness.run({
+            [&]() { loopback.write(client, std::string(100, 'x') + "\n" + std::string(100, 'y') + "\n"); return true; },
+            // Обработчик ждёт в write(), отключение будит его с false
+            [&]() { loopback.disconnect(client); return true; },
+            [&]() { return true; },
+        });
+        check(finished && sessionWrites == 0, "session write() fails when the client leaves while it waits");
+    }
+
+    void testUdp() {
+        Harness harness;
+        LoopbackTransport& loopback = harness.loopback();
+        int client = loopback.connectDatagram();
+        std::vector<std::string> replies;
+        bool finished = harness.run({
+            [&]() {
+                loopback.sendDatagram(client, "hello");
+                loopback.sendDatagram(client, "/set u 5");
+                loopback.sendDatagram(client, "/get u");
+                return true;
+            },
+            [&]() {
+                replies = loopback.receiveDatagrams(client);
+                return true;
+            },
+        });
+        check(finished && replies == std::vector<std::string>{"hello", "OK", "5"}, "udp echo and commands");
+    }
+
+    void testUdpSendQueue() {
+        constexpr size_t DATAGRAMS = 5;
+        Harness harness;
+        LoopbackTransport& loopback = harness.loopback();
+        // Один датаграм заполняет буфер клиента, остальные ждут в очереди сервера
+        loopback.setClientBufferLimit(8);
+        int client = loopback.connectDatagram();
+        std::vector<std::string> received;
+        bool finished = harness.run({
+            [&]() {
+                for (size_t i = 0; i < DATAGRAMS; ++i) {
+                    loopback.sendDatagram(client, "datagram " + std::to_string(i));
+                }
+                return true;
+            },
+            [&]() {
+                for (std::string& datagram : loopback.receiveDatagrams(client)) {
+                    received.push_back(std::move(datagram));
+                }
+                return received.size() >= DATAGRAMS;
+            },
+        });
+        bool ordered = received.size() == DATAGRAMS;
+        for (size_t i = 0; ordered && i < DATAGRAMS; ++i) {
+            ordered = received[i] == "datagram " + std::to_string(i);
+        }
+        check(finished && ordered, "udp replies queued on EAGAIN and flushed in order");
+    }
+}
+
+int main() {
+    // Сервер пишет в cout на каждое сообщение
+    std::cout.rdbuf(nullptr);
+
+    testEcho();
+    testPipelinedKeyValue();
+    testBackpressure();
+    testDisconnect();
+    testSessionWriteWaitsForDrain();
+    testSessionDisconnectWhileWriting();
+    testUdp();
+    testUdpSendQueue();
+
+    std::cerr << (failures == 0 ? "All loopback tests passed" : std::to_string(failures) + " loopback checks failed")
+              << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -1,16 +1,21 @@
 #!/usr/bin/env python3
 # network_test.py
 
+import json
+import os
 import socket
 import time
 import sys
 import random
 import string
+import tempfile
+import threading
 
 class ServerTester:
-    def __init__(self, host='127.0.0.77', port=8080):
+    def __init__(self, host='127.0.0.77', port=8080, unix_path='/tmp/async-server.sock'):
         self.host = host
         self.port = port
+        self.unix_path = unix_path
 
     def test_tcp_text(self, message):
         """Тестирование текстовых сообщений по TCP"""
@@ -48,6 +53,56 @@ class ServerTester:
             print(f"UDP TEXT ERROR: {e}")
             return None
 
+    def test_unix_stream(self, message):
+        """Тестирование unix stream сокета (сервер запущен с --unix)"""
+        try:
+            sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+            sock.settimeout(5)
+            sock.connect(self.unix_path)
+
+            sock.sendall((message + '\n').encode())
+            response = sock.recv(1024).decode().strip()
+
+            print(f"UNIX STREAM: '{message}' -> '{response}'")
+            sock.close()
+            return response
+
+        except Exception as e:
+            print(f"UNIX STREAM ERROR: {e}")
+            return None
+
+    def test_unix_dgram(self, message):
+        """Тестирование unix datagram сокета, клиенту нужен свой адрес для ответа"""
+        client_path = os.path.join(tempfile.gettempdir(), f"async-client-{os.getpid()}.sock")
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM)
+        try:
+            sock.settimeout(5)
+            sock.bind(client_path)
+
+            sock.sendto((message + '\n').encode(), self.unix_path + '.dgram')
+            response = sock.recv(1024).decode().strip()
+
+            print(f"UNIX DGRAM: '{message}' -> '{response}'")
+            return response
+
+        except Exception as e:
+            print(f"UNIX DGRAM ERROR: {e}")
+            return None
+        finally:
+            sock.close()
+            if os.path.exists(client_path):
+                os.unlink(client_path)
+
+    def test_unix_sockets(self):
+        """Проверка, что unix сокеты идут через тот же путь команд"""
+        if not os.path.exists(self.unix_path):
+            print(f"Unix socket {self.unix_path} not found, skipping")
+            return
+        ok = (self.test_unix_stream("/set unix-key local") == "OK"
+              and self.test_unix_dgram("/get unix-key") == "local"
+              and self.test_unix_stream("ping") == "ping")
+        print("✓ Unix socket test PASSED" if ok else "✗ Unix socket test FAILED")
+
     def test_tcp_binary(self, data):
         """Тестирование бинарных данных по TCP"""
         try:
@@ -142,10 +197,10 @@ class ServerTester:
     def test_binary_commands(self):
         """Тестирование бинарных данных, которые могут быть интерпретированы как команды"""
         binary_tests = [
-            b'/time\x00',  # Команда с нулевым байтом
-            b'\x2ftime',   # '/' в hex
-            b'\x00\x00/shutdown',  # Нулевые байты перед командой
-            b'/stats\xff\xfe',  # Команда с специальными байтами
+            b'/time\x00\n',  # Команда с нулевым байтом
+            b'\x2ftime\n',   # '/' в hex
+            b'\x00\x00/shutdown\n',  # Нулевые байты перед командой
+            b'/stats\xff\xfe\n',  # Команда с специальными байтами
         ]
 
         print("Testing binary commands...")
@@ -153,6 +208,441 @@ class ServerTester:
             self.test_tcp_binary(data)
             time.sleep(0.2)
 
+    def test_pubsub(self, num_subscribers=20):
+        """Тестирование /subscribe и /publish"""
+        print(f"Testing pub/sub with {num_subscribers} subscribers...")
+        subscribers = []
+        try:
+            for _ in range(num_subscribers):
+                sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+                sock.settimeout(5)
+                sock.connect((self.host, self.port))
+                sock.sendall(b"/subscribe news\n")
+                sock.recv(1024)
+                subscribers.append(sock)
+
+            publisher = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+            publisher.settimeout(5)
+            publisher.connect((self.host, self.port))
+            publisher.sendall(b"/publish news hello subscribers\n")
+            print(f"PUBLISH -> '{publisher.recv(1024).decode().strip()}'")
+            publisher.close()
+
+            received = 0
+            for sock in subscribers:
+                if sock.recv(1024).decode().strip() == "news: hello subscribers":
+                    received += 1
+            if received == num_subscribers:
+                print("✓ Pub/sub test PASSED")
+            else:
+                print(f"✗ Pub/sub test FAILED ({received}/{num_subscribers} received)")
+        except Exception as e:
+            print(f"PUBSUB ERROR: {e}")
+        finally:
+            for sock in subscribers:
+                sock.close()
+
+    def test_key_value(self):
+        """Тестирование /set, /get, /del, /incr, /expire по TCP и UDP"""
+        print("Testing key-value commands...")
+        checks = [
+            (self.test_tcp_text, "/set greeting hello world", "OK"),
+            (self.test_udp_text, "/get greeting", "hello world"),
+            (self.test_tcp_text, "/incr counter", "1"),
+            (self.test_udp_text, "/incr counter", "2"),
+            (self.test_tcp_text, "/incr greeting", "ERR value is not an integer or out of range"),
+            (self.test_tcp_text, "/expire greeting 99999999999",
+             "ERR expire time is out of range (max 315360000 seconds)"),
+            (self.test_tcp_text, "/expire greeting 1", "1"),
+            (self.test_tcp_text, "/del counter", "1"),
+            (self.test_udp_text, "/get counter", "(nil)"),
+        ]
+        failed = 0
+        for send, command, expected in checks:
+            if send(command) != expected:
+                failed += 1
+        time.sleep(1.5)
+        if self.test_tcp_text("/get greeting") != "(nil)":
+            failed += 1
+        if failed == 0:
+            print("✓ Key-value test PASSED")
+        else:
+            print(f"✗ Key-value test FAILED ({failed} mismatches)")
+
+    def test_pipelining(self, count=100):
+        """Запросы пачкой: строки, разрезанные границей чтения, не должны теряться"""
+        print(f"Testing {count} pipelined requests...")
+        sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        sock.settimeout(5)
+        try:
+            sock.connect((self.host, self.port))
+            batch = "".join(f"/set pipe{i:03} value{i:03}\n" for i in range(count))
+            sock.sendall(batch.encode())
+            data = b""
+            while data.count(b"\n") < count:
+                chunk = sock.recv(65536)
+                if not chunk:
+                    break
+                data += chunk
+            replies = data.decode(errors="replace").splitlines()
+            sock.sendall("".join(f"/get pipe{i:03}\n" for i in range(count)).encode())
+            data = b""
+            while data.count(b"\n") < count:
+                chunk = sock.recv(65536)
+                if not chunk:
+                    break
+                data += chunk
+            values = data.decode(errors="replace").splitlines()
+        finally:
+            sock.close()
+        expected = [f"value{i:03}" for i in range(count)]
+        if replies == ["OK"] * count and values == expected:
+            print(f"✓ Pipelining test PASSED ({len(batch)} bytes in one write)")
+        else:
+            wrong = [(i, v) for i, v in enumerate(values) if i >= len(expected) or v != expected[i]]
+            print(f"✗ Pipelining test FAILED: {replies.count('OK')}/{count} OK, wrong values {wrong[:3]}")
+
+    def test_session(self, lines=6000, size=4096):
+        """Корутинный обработчик (сервер запущен с --session echo): медленный читатель не переполняет очередь"""
+        print(f"Testing session echo with {lines} lines of {size} bytes, read only after sending...")
+        sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        sock.settimeout(10)
+        try:
+            sock.connect((self.host, self.port))
+            # Команды в режиме сессии не выполняются, а возвращаются как есть
+            sock.sendall(b"/time\n")
+            reply = sock.recv(4096)
+            if reply != b"/time\n":
+                print("- Session skipped: server started without --session echo")
+                return
+            # Ответов больше, чем очередь вывода сервера (8 МБ): без ожидания в write() клиента отключат
+            payload = b"".join(b"%05d" % i + b"x" * (size - 6) + b"\n" for i in range(lines))
+            data = b""
+            error = ""
+            try:
+                sock.sendall(payload)
+                time.sleep(0.5)
+                while len(data) < len(payload):
+                    chunk = sock.recv(1 << 20)
+                    if not chunk:
+                        break
+                    data += chunk
+            except OSError as e:
+                error = f", {e}"
+        finally:
+            sock.close()
+        if data == payload:
+            print(f"✓ Session test PASSED ({len(data)} bytes echoed in order)")
+        else:
+            print(f"✗ Session test FAILED: {len(data)} of {len(payload)} bytes{error}")
+
+    def test_clients(self):
+        """Топ клиентов по частоте запросов и трафику"""
+        print("Testing /clients...")
+        sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        sock.settimeout(2)
+        try:
+            sock.connect((self.host, self.port))
+            local_port = sock.getsockname()[1]
+            for _ in range(20):
+                sock.sendall(b"hammer\n")
+                sock.recv(1024)
+                time.sleep(0.01)
+            sock.sendall(b"/clients 1\n")
+            by_rate = sock.recv(4096).decode()
+            sock.sendall(b"/clients 5 bytes\n")
+            by_bytes = sock.recv(4096).decode()
+        finally:
+            sock.close()
+        if by_rate.startswith("Top 1 of") and f":{local_port}: 20 requests" in by_rate and by_bytes.startswith("Top "):
+            print("✓ Clients test PASSED")
+        else:
+            print(f"✗ Clients test FAILED: {by_rate!r} / {by_bytes!r}")
+
+    def test_get_file(self, name="small.txt"):
+        """Отдача файла через /get-file (сервер запущен с --files DIR)"""
+        print(f"Testing /get-file {name}...")
+        sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        sock.settimeout(5)
+        try:
+            sock.connect((self.host, self.port))
+            sock.sendall(f"/get-file {name}\n".encode())
+            data = b""
+            while b"\n" not in data:
+                chunk = sock.recv(65536)
+                if not chunk:
+                    break
+                data += chunk
+            header, _, body = data.partition(b"\n")
+            if header == b"ERR file serving is disabled":
+                print("- /get-file skipped: server started without --files")
+                return
+            if not header.startswith(b"FILE "):
+                print(f"✗ Get-file test FAILED: {header!r}")
+                return
+            size = int(header.split()[1])
+            while len(body) < size:
+                chunk = sock.recv(1 << 20)
+                if not chunk:
+                    break
+                body += chunk
+            sock.sendall(b"/get-file ../etc/passwd\n")
+            rejected = sock.recv(1024)
+        finally:
+            sock.close()
+        if len(body) == size and rejected.startswith(b"ERR"):
+            print(f"✓ Get-file test PASSED ({size} bytes)")
+        else:
+            print(f"✗ Get-file test FAILED: got {len(body)} of {size} bytes, traversal reply {rejected!r}")
+
+    def read_trace_dump(self, path="/tmp/async-server-trace.json", timeout=3):
+        """Дамп пишется в отдельном потоке сервера: ждём, пока файл появится целиком"""
+        deadline = time.time() + timeout
+        while True:
+            try:
+                with open(path) as f:
+                    return json.load(f)["traceEvents"]
+            except (OSError, ValueError, KeyError):
+                if time.time() > deadline:
+                    raise
+                time.sleep(0.05)
+
+    def test_trace(self):
+        """Сэмплированная трассировка и дамп в формате Chrome trace"""
+        print("Testing request tracing...")
+        dump_path = "/tmp/async-server-trace.json"
+        # Клиент не выбирает путь дампа: иначе любой пир мог бы затереть файл сервера
+        probe = os.path.join(tempfile.gettempdir(), f"async-trace-probe-{os.getpid()}.json")
+        rejected = self.test_tcp_text(f"/trace-dump {probe}")
+        if os.path.exists(probe) or not rejected.startswith("Usage"):
+            print(f"✗ Trace test FAILED: client path accepted ({rejected!r})")
+            return
+        self.test_tcp_text("/trace-sample 1")
+        self.test_tcp_text("/time")
+        self.test_udp_text("/time")
+        if os.path.exists(dump_path):
+            os.unlink(dump_path)
+        reply = self.test_tcp_text("/trace-dump")
+        self.test_tcp_text("/trace-sample 0")
+        try:
+            events = self.read_trace_dump(dump_path)
+            os.unlink(dump_path)
+        except (OSError, ValueError, KeyError) as e:
+            print(f"✗ Trace test FAILED: {reply} ({e})")
+            return
+        names = {event["name"] for event in events}
+        expected = {"request", "tcp-recv", "udp-recv", "parse", "process", "tcp-send", "udp-send"}
+        if not (expected <= names and all(event["ph"] == "X" for event in events)):
+            print(f"✗ Trace test FAILED: missing {expected - names}")
+            return
+
+        # Постоянное соединение: пустые чтения в конце каждого цикла не должны съедать выборку
+        sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        sock.settimeout(5)
+        try:
+            sock.connect((self.host, self.port))
+            sock.sendall(b"/trace-sample 2\n")
+            sock.recv(1024)
+            for i in range(40):
+                sock.sendall(f"traced {i}\n".encode())
+                sock.recv(1024)
+            sock.sendall(f"/trace-sample 0\n".encode())
+            sock.recv(1024)
+            sock.sendall(b"/trace-dump\n")
+            sock.recv(1024)
+        finally:
+            sock.close()
+        try:
+            sampled = self.read_trace_dump(dump_path)
+            os.unlink(dump_path)
+        except (OSError, ValueError, KeyError) as e:
+            print(f"✗ Trace test FAILED: second dump ({e})")
+            return
+        requests = sum(event["name"] == "request" for event in sampled) - sum(event["name"] == "request" for event in events)
+        # 41 чтений с данными (40 запросов и /trace-sample 0), плюс запрос после первого дампа
+        if 19 <= requests <= 23:
+            print(f"✓ Trace test PASSED ({len(events)} spans, {requests} of 40 reads sampled at 1/2)")
+        else:
+            print(f"✗ Trace test FAILED: {requests} of 40 reads sampled at 1/2")
+
+    def start_flood(self, flood_bytes=4 * 1024 * 1024):
+        """Клиент, заливающий сервер эхо-трафиком; возвращает функцию остановки"""
+        line = b"x" * 1023 + b"\n"
+        flood = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        flood.settimeout(5)
+        flood.connect((self.host, self.port))
+        stop = threading.Event()
+
+        def drain():
+            # Эхо-ответы забираем, иначе упрёмся в лимит очереди вывода
+            while not stop.is_set():
+                try:
+                    if not flood.recv(65536):
+                        break
+                except OSError:
+                    break
+
+        def pump():
+            sent = 0
+            while sent < flood_bytes and not stop.is_set():
+                flood.sendall(line * 64)
+                sent += len(line) * 64
+
+        reader = threading.Thread(target=drain)
+        writer = threading.Thread(target=pump)
+        reader.start()
+        writer.start()
+
+        def finish():
+            stop.set()
+            writer.join()
+            flood.shutdown(socket.SHUT_RDWR)
+            flood.close()
+            reader.join()
+        return finish
+
+    def test_read_fairness(self):
+        """Клиент, заливающий сервер данными, не должен задерживать остальных"""
+        print("Testing read fairness under a flooding client...")
+        finish = self.start_flood()
+        worst = 0.0
+        try:
+            probe = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+            probe.settimeout(5)
+            probe.connect((self.host, self.port))
+            for _ in range(20):
+                started = time.time()
+                probe.sendall(b"/time\n")
+                probe.recv(1024)
+                worst = max(worst, time.time() - started)
+            probe.sendall(b"/stats\n")
+            stats = probe.recv(8192).decode(errors="replace")
+            probe.close()
+        finally:
+            finish()
+        yields = int(stats.split("Read budget yields: ")[1].split()[0]) if "Read budget yields: " in stats else -1
+        if worst < 1.0 and yields >= 0:
+            print(f"✓ Read fairness test PASSED (worst /time {worst * 1000:.1f} ms, {yields} budget yields)")
+        else:
+            print(f"✗ Read fairness test FAILED: worst /time {worst * 1000:.1f} ms, yields {yields}")
+
+    def test_priority_lane(self, admin_port=8081):
+        """/stats через админский порт под нагрузкой (сервер запущен с --admin-port)"""
+        print(f"Testing priority lane on admin port {admin_port}...")
+        admin = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        admin.settimeout(5)
+        try:
+            admin.connect((self.host, admin_port))
+        except ConnectionRefusedError:
+            print("- Priority lane skipped: server started without --admin-port")
+            admin.close()
+            return
+        finish = self.start_flood()
+        try:
+            started = time.time()
+            admin.sendall(b"/stats\n")
+            stats = admin.recv(8192).decode(errors="replace")
+            elapsed = time.time() - started
+            admin.sendall(b"hello\n")
+            echo = admin.recv(1024)
+        finally:
+            finish()
+            admin.close()
+        if stats.startswith("Server statistics") and "Priority lane events: " in stats and echo == b"hello\n":
+            print(f"✓ Priority lane test PASSED (/stats in {elapsed * 1000:.1f} ms)")
+        else:
+            print(f"✗ Priority lane test FAILED: {stats[:80]!r} / {echo!r}")
+
+    def test_upstream(self, prefix="/db", backend_port=9090):
+        """Прокси на бэкенд (сервер запущен с --upstream /db=127.0.0.1:9090)"""
+        print(f"Testing upstream proxy {prefix} -> 127.0.0.1:{backend_port}...")
+        listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        listener.bind(("127.0.0.1", backend_port))
+        listener.listen()
+        backends = []
+        stopped = threading.Event()
+
+        def serve(conn):
+            # Заглушка бэкенда: одна строка ответа на каждую строку запроса
+            buffered = b""
+            while True:
+                try:
+                    chunk = conn.recv(65536)
+                except OSError:
+                    break
+                if not chunk:
+                    break
+                buffered += chunk
+                *lines, buffered = buffered.split(b"\n")
+                conn.sendall(b"".join(b"backend " + line + b"\n" for line in lines))
+            conn.close()
+
+        def accept():
+            while True:
+                try:
+                    conn, _ = listener.accept()
+                except OSError:
+                    break
+                if stopped.is_set():
+                    conn.close()
+                    break
+                backends.append(conn)
+                threading.Thread(target=serve, args=(conn,), daemon=True).start()
+
+        threading.Thread(target=accept, daemon=True).start()
+
+        def read_lines(sock, count):
+            data = b""
+            while data.count(b"\n") < count:
+                chunk = sock.recv(4096)
+                if not chunk:
+                    break
+                data += chunk
+            return data.decode(errors="replace").splitlines()
+
+        sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        sock.settimeout(5)
+        try:
+            sock.connect((self.host, self.port))
+            # Пул переподключается с задержкой, ждём пока бэкенд станет доступен
+            deadline = time.time() + 8
+            while True:
+                sock.sendall(f"{prefix} ping\n".encode())
+                reply = sock.recv(4096).decode(errors="replace")
+                if reply.startswith("Unknown command"):
+                    print("- Upstream skipped: server started without --upstream")
+                    return
+                if not reply.startswith("ERR") or time.time() > deadline:
+                    break
+                time.sleep(0.2)
+            sock.sendall(f"{prefix} a\n{prefix} b\n{prefix} c\n".encode())
+            pipelined = read_lines(sock, 3)
+            # Префикс - целое слово: /dbx и /db2 обрабатываются локально
+            sock.sendall(f"{prefix}x hello\n{prefix}2 hello\n".encode())
+            unrelated = read_lines(sock, 2)
+            sock.sendall(b"/upstreams\n")
+            stats = sock.recv(4096).decode(errors="replace")
+
+            stopped.set()
+            listener.shutdown(socket.SHUT_RDWR)
+            listener.close()
+            for conn in backends:
+                conn.shutdown(socket.SHUT_RDWR)
+            time.sleep(0.3)
+            sock.sendall(f"{prefix} down\n".encode())
+            failed = sock.recv(4096).decode(errors="replace")
+        finally:
+            sock.close()
+            listener.close()
+        expected = [f"backend {prefix} a", f"backend {prefix} b", f"backend {prefix} c"]
+        local = len(unrelated) == 2 and not any(line.startswith(("backend", "ERR upstream")) for line in unrelated)
+        if (reply == f"backend {prefix} ping\n" and pipelined == expected and local
+                and f"{prefix} -> 127.0.0.1:{backend_port}: up" in stats and failed.startswith("ERR upstream")):
+            print("✓ Upstream test PASSED")
+        else:
+            print(f"✗ Upstream test FAILED: {reply!r} / {pipelined} / {unrelated} / {stats!r} / {failed!r}")
+
     def test_performance(self, num_requests=100):
         """Тестирование производительности"""
         print(f"Performance test: {num_requests} requests")
@@ -186,6 +676,17 @@ class ServerTester:
             ("Special Characters", self.test_special_characters),
             ("Large Data", lambda: self.test_large_data(5000)),
             ("Binary Data", self.test_binary_commands),
+            ("Pub/Sub", self.test_pubsub),
+            ("Key-Value", self.test_key_value),
+            ("Pipelining", self.test_pipelining),
+            ("Unix Sockets", self.test_unix_sockets),
+            ("Clients", self.test_clients),
+            ("Tracing", self.test_trace),
+            ("Get File", self.test_get_file),
+            ("Read Fairness", self.test_read_fairness),
+            ("Priority Lane", self.test_priority_lane),
+            ("Upstream", self.test_upstream),
+            ("Session", self.test_session),
             ("Performance", lambda: self.test_performance(50))
         ]
 
@@ -205,6 +706,28 @@ if __name__ == "__main__":
             tester.test_tcp_text(" ".join(sys.argv[2:]))
         elif sys.argv[1] == "udp":
             tester.test_udp_text(" ".join(sys.argv[2:]))
+        elif sys.argv[1] == "unix":
+            tester.test_unix_sockets()
+        elif sys.argv[1] == "kv":
+            tester.test_key_value()
+        elif sys.argv[1] == "pipeline":
+            tester.test_pipelining()
+        elif sys.argv[1] == "clients":
+            tester.test_clients()
+        elif sys.argv[1] == "file":
+            tester.test_get_file(*sys.argv[2:3])
+        elif sys.argv[1] == "trace":
+            tester.test_trace()
+        elif sys.argv[1] == "fairness":
+            tester.test_read_fairness()
+        elif sys.argv[1] == "priority":
+            tester.test_priority_lane(*map(int, sys.argv[2:3]))
+        elif sys.argv[1] == "upstream":
+            tester.test_upstream()
+        elif sys.argv[1] == "session":
+            tester.test_session()
+        elif sys.argv[1] == "pubsub":
+            tester.test_pubsub()
         elif sys.argv[1] == "binary":
             tester.test_tcp_binary(b''.join(bytes(arg, 'utf-8') for arg in sys.argv[2:]))
         else:
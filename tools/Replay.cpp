@@ -0,0 +1,384 @@
+// Воспроизведение записанного трафика (--capture) против работающего сервера.
+//     ./AsyncServerReplay <capture> [host] [port] [speed]
+// speed: 1 - как было записано, N - в N раз быстрее, max - без пауз
+// (на max TCP соединение шлёт следующую запись только после ответов на все строки предыдущей).
+// Ответы сопоставляются с запросами построчно, поэтому команды, ответ на которые не одна строка
+// (/stats, /clients, /get-file, /subscribe...), не воспроизводятся и считаются пропущенными.
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <netinet/in.h>
+#include <string>
+#include <string_view>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "App/CommandProcessor.h"
+#include "App/TextScan.h"
+#include "App/TrafficCapture.h"
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    // Requests held back at max speed: the lines of one captured record
+    struct Batch {
+        std::string data;
+        size_t requests = 0;
+    };
+
+    // One captured TCP connection or UDP peer, replayed over its own socket
+    struct Connection {
+        int fd = -1;
+        bool udp = false;
+        bool closing = false;
+        bool closeRequested = false;
+        std::string partial;                    // TCP: captured bytes after the last '\n'
+        std::deque<Clock::time_point> pending;  // send times of requests still waiting for a reply
+        std::deque<Batch> backlog;              // max speed: records held until the previous one is answered
+    };
+
+    // The server answers every TCP line with exactly one line, except for these. Control commands
+    // print several lines, /get-file is followed by the file and /subscribe by later deliveries.
+    bool hasOneLineReply(std::string_view frame) {
+        return !CommandProcessor::isControlCommand(frame) && !frame.starts_with("/get-file")
+            && !frame.starts_with("/subscribe");
+    }
+
+    class Replayer {
+    public:
+        Replayer(const sockaddr_in& server, double speed) : m_server(server), m_speed(speed) {
+            m_epoll_fd = epoll_create1(0);
+        }
+        ~Replayer() {
+            for (auto& [key, connection] : m_connections) {
+                if (connection.fd != -1) ::close(connection.fd);
+            }
+            ::close(m_epoll_fd);
+        }
+
+        bool run(const char* data, size_t size);
+        void report() const;
+
+    private:
+        static constexpr auto DRAIN_TIMEOUT = std::chrono::seconds(2);
+
+        Connection* open(uint64_t key, bool udp);
+        void closeConnection(Connection& connection);
+        void send(Connection& connection, std::string_view payload);
+        // Complete lines of the TCP stream that get one reply each, the rest stays in partial
+        Batch takeLines(Connection& connection, std::string_view payload);
+        void transmit(Connection& connection, const Batch& batch);
+        void replyReceived(Connection& connection);
+        // Reads whatever replies arrived, waiting at most timeoutMs
+        void poll(int timeoutMs);
+
+        sockaddr_in m_server;
+        double m_speed;  // 0 - as fast as possible
+        int m_epoll_fd = -1;
+        std::unordered_map<uint64_t, Connection> m_connections;
+        std::unordered_map<int, Connection*> m_byFd;
+
+        std::vector<uint64_t> m_latenciesNs;
+        uint64_t m_queued = 0;  // requests taken from the capture
+        uint64_t m_sent = 0;
+        uint64_t m_skipped = 0;
+        uint64_t m_errors = 0;
+        Clock::duration m_elapsed{};
+    };
+
+    bool Replayer::run(const char* data, size_t size) {
+        const char* pos = data + sizeof(CaptureFileHeader);
+        const char* end = data + size;
+        const auto started = Clock::now();
+
+        while (pos + sizeof(CaptureRecordHeader) <= end) {
+            CaptureRecordHeader header;
+            std::memcpy(&header, pos, sizeof(header));
+            pos += sizeof(header);
+            if (pos + header.length > end) {
+                std::cerr << "Capture is truncated, stopping at a partial record" << std::endl;
+                break;
+            }
+            std::string_view payload(pos, header.length);
+            pos += header.length;
+
+            if (m_speed > 0) {
+                auto due = started + std::chrono::nanoseconds(static_cast<int64_t>(header.timestampNs / m_speed));
+                for (auto now = Clock::now(); now < due; now = Clock::now()) {
+                    poll(static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(due - now).count()));
+                }
+            } else {
+                poll(0);
+            }
+
+            const bool udp = header.type == CaptureRecordType::Udp;
+            const uint64_t key = (uint64_t{udp} << 32) | header.connectionId;
+            if (header.type == CaptureRecordType::TcpClose) {
+                auto it = m_connections.find(key);
+                if (it != m_connections.end()) {
+                    closeConnection(it->second);
+                }
+                continue;
+            }
+            if (udp && payload.starts_with("/shutdown")) {
+                // Replaying a shutdown would end the run early; TCP lines are filtered in send()
+                ++m_skipped;
+                continue;
+            }
+            Connection* connection = open(key, udp);
+            if (connection && header.type != CaptureRecordType::TcpOpen) {
+                send(*connection, payload);
+            }
+        }
+
+        auto last_reply = Clock::now();
+        while (Clock::now() - last_reply < DRAIN_TIMEOUT) {
+            size_t answered = m_latenciesNs.size();
+            poll(100);
+            if (m_latenciesNs.size() != answered) {
+                last_reply = Clock::now();
+            }
+            if (m_latenciesNs.size() == m_sent && m_queued == m_sent) {
+                break;
+            }
+        }
+        m_elapsed = Clock::now() - started;
+        return true;
+    }
+    Connection* Replayer::open(uint64_t key, bool udp) {
+        Connection& connection = m_connections[key];
+        if (connection.fd != -1) {
+            return &connection;
+        }
+        if (connection.closing) {
+            return nullptr;
+        }
+        connection.udp = udp;
+        int fd = ::socket(AF_INET, udp ? SOCK_DGRAM : SOCK_STREAM, 0);
+        // Blocking connect keeps the order of records, the socket turns non-blocking after it
+        if (fd == -1 || ::connect(fd, reinterpret_cast<const sockaddr*>(&m_server), sizeof(m_server)) == -1) {
+            std::cerr << "Cannot connect: " << strerror(errno) << std::endl;
+            if (fd != -1) ::close(fd);
+            ++m_errors;
+            connection.closing = true;
+            return nullptr;
+        }
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event);
+        connection.fd = fd;
+        m_byFd[fd] = &connection;
+        return &connection;
+    }
+    void Replayer::closeConnection(Connection &connection) {
+        if (connection.fd == -1 || connection.closing) {
+            return;
+        }
+        if (!connection.backlog.empty()) {
+            connection.closeRequested = true;
+            return;
+        }
+        // Half-close: replies still on the way are read until the server closes too
+        connection.closing = true;
+        ::shutdown(connection.fd, SHUT_WR);
+    }
+    void Replayer::send(Connection &connection, std::string_view payload) {
+        if (payload.empty() || connection.closing) {
+            return;
+        }
+        // A datagram is one request with one reply datagram
+        Batch batch = connection.udp ? Batch{std::string(payload), 1} : takeLines(connection, payload);
+        if (batch.requests == 0) {
+            return;
+        }
+        m_queued += batch.requests;
+        // Closed loop at max speed: each connection has one record's requests in flight
+        if (m_speed == 0 && !connection.udp && !connection.pending.empty()) {
+            connection.backlog.push_back(std::move(batch));
+            return;
+        }
+        transmit(connection, batch);
+    }
+    Batch Replayer::takeLines(Connection &connection, std::string_view payload) {
+        // Records are server reads, a line may continue in the next record of the connection
+        std::string stream;
+        if (!connection.partial.empty()) {
+            stream = std::move(connection.partial);
+            connection.partial.clear();
+            stream += payload;
+            payload = stream;
+        }
+        Batch batch;
+        while (true) {
+            size_t newline = TextScan::find(payload, '\n');
+            if (newline == std::string_view::npos) {
+                break;
+            }
+            std::string_view line = payload.substr(0, newline + 1);
+            std::string_view frame = TextScan::trimRight(line);
+            payload.remove_prefix(newline + 1);
+            // Empty lines get no reply from the server
+            if (frame.empty()) {
+                continue;
+            }
+            if (!hasOneLineReply(frame)) {
+                ++m_skipped;
+                continue;
+            }
+            batch.data += line;
+            ++batch.requests;
+        }
+        connection.partial.assign(payload);
+        return batch;
+    }
+    void Replayer::transmit(Connection &connection, const Batch& batch) {
+        ssize_t sent = ::send(connection.fd, batch.data.data(), batch.data.size(), MSG_NOSIGNAL);
+        if (sent != static_cast<ssize_t>(batch.data.size())) {
+            ++m_errors;
+            return;
+        }
+        const auto now = Clock::now();
+        connection.pending.insert(connection.pending.end(), batch.requests, now);
+        m_sent += batch.requests;
+    }
+    void Replayer::replyReceived(Connection &connection) {
+        if (connection.pending.empty()) {
+            return;
+        }
+        m_latenciesNs.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                Clock::now() - connection.pending.front()).count());
+        connection.pending.pop_front();
+        if (!connection.pending.empty()) {
+            return;
+        }
+        if (!connection.backlog.empty()) {
+            Batch next = std::move(connection.backlog.front());
+            connection.backlog.pop_front();
+            transmit(connection, next);
+        } else if (connection.closeRequested) {
+            closeConnection(connection);
+        }
+    }
+    void Replayer::poll(int timeoutMs) {
+        constexpr int MAX_EVENTS = 64;
+        epoll_event events[MAX_EVENTS];
+        int count = epoll_wait(m_epoll_fd, events, MAX_EVENTS, std::max(timeoutMs, 0));
+        char buffer[64 * 1024];
+        for (int i = 0; i < count; ++i) {
+            auto it = m_byFd.find(events[i].data.fd);
+            if (it == m_byFd.end()) {
+                continue;
+            }
+            Connection& connection = *it->second;
+            while (true) {
+                ssize_t bytes = ::recv(connection.fd, buffer, sizeof(buffer), 0);
+                if (bytes > 0) {
+                    // A datagram is one reply. On TCP every '\n' ends one, a read may hold several
+                    // or only part of one; each is matched with the oldest request.
+                    size_t replies = connection.udp ? 1 : static_cast<size_t>(std::count(buffer, buffer + bytes, '\n'));
+                    for (size_t reply = 0; reply < replies && connection.fd != -1; ++reply) {
+                        replyReceived(connection);
+                    }
+                    continue;
+                }
+                if (bytes == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                    epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, connection.fd, nullptr);
+                    m_byFd.erase(connection.fd);
+                    ::close(connection.fd);
+                    connection.fd = -1;
+                    connection.closing = true;
+                }
+                break;
+            }
+        }
+    }
+    void Replayer::report() const {
+        std::vector<uint64_t> sorted = m_latenciesNs;
+        std::sort(sorted.begin(), sorted.end());
+        auto percentile = [&sorted](double q) -> double {
+            if (sorted.empty()) return 0.0;
+            return sorted[static_cast<size_t>(q * (sorted.size() - 1))] / 1000.0;
+        };
+        double seconds = std::chrono::duration<double>(m_elapsed).count();
+
+        std::cout << std::fixed << std::setprecision(1)
+                  << "Connections: " << m_connections.size() << ", requests sent: " << m_sent
+                  << ", replies: " << sorted.size() << ", unanswered: " << m_queued - std::min<uint64_t>(m_queued, sorted.size())
+                  << ", skipped: " << m_skipped << ", errors: " << m_errors << "\n"
+                  << "Elapsed: " << seconds << " s, " << (seconds > 0 ? m_sent / seconds : 0.0) << " requests/s\n"
+                  << "Latency us: p50 " << percentile(0.5) << ", p90 " << percentile(0.9)
+                  << ", p99 " << percentile(0.99) << ", max " << percentile(1.0) << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <capture> [host] [port] [1|N|max]" << std::endl;
+        return 1;
+    }
+    std::string host = argc > 2 ? argv[2] : "127.0.0.77";
+    int port = argc > 3 ? std::atoi(argv[3]) : 8080;
+    std::string speedArg = argc > 4 ? argv[4] : "1";
+    double speed = speedArg == "max" ? 0.0 : std::atof(speedArg.c_str());
+    if (speedArg != "max" && speed <= 0) {
+        std::cerr << "Speed must be a positive multiplier or 'max'" << std::endl;
+        return 1;
+    }
+
+    sockaddr_in server{};
+    server.sin_family = AF_INET;
+    server.sin_port = htons(port);
+    if (inet_pton(AF_INET, host.c_str(), &server.sin_addr) != 1) {
+        std::cerr << "Invalid server address " << host << std::endl;
+        return 1;
+    }
+
+    int fd = ::open(argv[1], O_RDONLY | O_CLOEXEC);
+    struct stat info{};
+    if (fd == -1 || ::fstat(fd, &info) == -1) {
+        std::cerr << "Cannot open capture " << argv[1] << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+    size_t size = static_cast<size_t>(info.st_size);
+    CaptureFileHeader header{};
+    if (size < sizeof(header)) {
+        std::cerr << "Not a capture file: " << argv[1] << std::endl;
+        return 1;
+    }
+    void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        std::cerr << "mmap failed: " << strerror(errno) << std::endl;
+        return 1;
+    }
+    ::madvise(mapped, size, MADV_SEQUENTIAL);
+    const char* data = static_cast<const char*>(mapped);
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, CAPTURE_MAGIC, sizeof(header.magic)) != 0 || header.version != CAPTURE_VERSION) {
+        std::cerr << "Unsupported capture format in " << argv[1] << std::endl;
+        ::munmap(mapped, size);
+        return 1;
+    }
+
+    std::cout << "Replaying " << argv[1] << " (" << size << " bytes) against " << host << ":" << port
+              << " at " << (speed > 0 ? speedArg + "x" : std::string("max")) << " speed" << std::endl;
+    Replayer replayer(server, speed);
+    replayer.run(data, size);
+    replayer.report();
+    ::munmap(mapped, size);
+    return 0;
+}
@@ -0,0 +1,78 @@
+// Живой мониторинг сервера через разделяемую память, без запросов к самому серверу.
+//     ./AsyncServerStats [/async-server-stats] [interval-ms] [count]
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "App/StatsSegment.h"
+
+namespace {
+    double perSecond(uint64_t now, uint64_t before, double seconds) {
+        return seconds > 0 ? static_cast<double>(now - before) / seconds : 0.0;
+    }
+
+    void printRates(const StatsSnapshot& now, const StatsSnapshot& before) {
+        double seconds = static_cast<double>(now.publishedNs - before.publishedNs) / 1e9;
+        uint64_t idle = now.loopIdleNs - before.loopIdleNs;
+        uint64_t busy = now.loopBusyNs - before.loopBusyNs;
+        uint64_t lookups = (now.kvHits - before.kvHits) + (now.kvMisses - before.kvMisses);
+
+        std::cout << std::fixed << std::setprecision(1)
+                  << "clients " << now.currentClients << " (+" << now.totalClients - before.totalClients << ")"
+                  << " | events " << perSecond(now.loopEvents, before.loopEvents, seconds) << "/s"
+                  << " wakeups " << perSecond(now.loopWakeups, before.loopWakeups, seconds) << "/s"
+                  << " | loop busy " << (idle + busy ? 100.0 * busy / (idle + busy) : 0.0) << "%"
+                  << " max lag " << now.loopMaxLagNs / 1000 << " us"
+                  << " | kv " << perSecond(lookups, 0, seconds) << " lookups/s, hit "
+                  << (lookups ? 100.0 * (now.kvHits - before.kvHits) / lookups : 0.0) << "%"
+                  << " keys " << now.kvKeys
+                  << " | udp queue " << now.udpQueueDepth
+                  << " | slow " << now.slowCallbacks - before.slowCallbacks;
+        for (size_t i = 0; i < LoopStats::HANDLER_COUNT; ++i) {
+            uint64_t calls = now.handlerCalls[i] - before.handlerCalls[i];
+            if (calls > 0) {
+                std::cout << " | " << loopHandlerName(static_cast<LoopHandler>(i)) << " "
+                          << perSecond(calls, 0, seconds) << "/s avg "
+                          << (now.handlerTotalNs[i] - before.handlerTotalNs[i]) / calls / 1000.0 << " us";
+            }
+        }
+        std::cout << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::string name = argc > 1 ? argv[1] : "/async-server-stats";
+    auto interval = std::chrono::milliseconds(argc > 2 ? std::atoi(argv[2]) : 1000);
+    long count = argc > 3 ? std::atol(argv[3]) : 0;  // 0 - until interrupted
+
+    StatsSegmentReader reader;
+    if (!reader.open(name)) {
+        return 1;
+    }
+    std::cout << "Reading " << name << " of server pid " << reader.getPid() << std::endl;
+
+    StatsSnapshot before{};
+    if (!reader.read(before)) {
+        std::cerr << "Could not take a consistent snapshot" << std::endl;
+        return 1;
+    }
+    for (long printed = 0; count == 0 || printed < count; ++printed) {
+        std::this_thread::sleep_for(interval);
+        StatsSnapshot now{};
+        if (!reader.read(now)) {
+            std::cerr << "Could not take a consistent snapshot" << std::endl;
+            continue;
+        }
+        if (now.publishedNs == before.publishedNs) {
+            std::cout << "no update (server stopped?)" << std::endl;
+            continue;
+        }
+        printRates(now, before);
+        before = now;
+    }
+    return 0;
+}